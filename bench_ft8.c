@@ -0,0 +1,1044 @@
+// Benchmarks for the decoder building blocks
+// bench_ft8 fft [sample_rate ...]   Per-frame cost of each FFT backend at the FFT sizes the decoder uses
+// bench_ft8 sync [-4] [-n survivors] [-t threads] file.wav ...
+//                                   Exhaustive vs coarse-to-fine sync search: time, candidate and decode recall;
+//                                   with -t, also the exhaustive search split over threads (must match it exactly)
+// bench_ft8 llr [-4] file.wav ...   Log-likelihood extraction: scalar reference vs vectorized,
+//                                   time per candidate and how many candidates' LLRs differ from the reference
+// bench_ft8 bits [-n codewords]     Parity checks, hard decision packing and CRC-14: the byte-per-bit versions
+//                                   vs packed words and the CRC table, with a check that they agree
+// bench_ft8 hashcall [-n callsigns] [-t threads]
+//                                   Callsign hash store: time per save and per lookup, share of recent callsigns
+//                                   resolved, and a check that every callsign found has the hash looked up
+// bench_ft8 ldpc [-i iterations] [-n codewords]
+//                                   LDPC decoders on random codewords in BPSK + white noise: success rate and time
+// bench_ft8 osd [-n codewords] [-e max_errors]
+//                                   What ordered statistics decoding after BP gains at each depth, and what it costs
+// bench_ft8 ddc [-r sample_rate] [-b bands] [-n signals] [-s snr] [-w file.wav]
+//                                   Decoding a synthetic wideband slot at full rate vs through the down-converter
+
+#define _GNU_SOURCE 1
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ft8/constants.h"
+#include "ft8/decode.h"
+#include "ft8/encode.h"
+#include "ft8/ldpc.h"
+#include "ft8/crc.h"
+#include "ft8/hashcall.h"
+#include "ft8/pack.h"
+#include "ft8/synth.h"
+#include "common/ddc.h"
+#include "common/rfft.h"
+#include "common/wave.h"
+#include "decode_ft8.h"
+
+#define FREQ_OSR 2 // Same as kFreq_osr in decode_ft8.c
+#define TIME_OSR 2 // Same as kTime_osr in decode_ft8.c
+extern const int kMax_decoded_messages; // Size of the decoder's duplicate table (decode_ft8.c)
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Average time of one forward FFT in microseconds
+static double time_rfft(int nfft, rfft_backend_t backend)
+{
+    rfft_t fft;
+    if (!rfft_init(&fft, nfft, backend))
+        return -1;
+    for (int i = 0; i < nfft; ++i)
+        fft.in[i] = (float)rand() / RAND_MAX - 0.5f;
+
+    rfft_execute(&fft); // Warm up caches
+    int runs = 0;
+    double start = now_sec(), elapsed;
+    do
+    {
+        for (int i = 0; i < 100; ++i)
+            rfft_execute(&fft);
+        runs += 100;
+        elapsed = now_sec() - start;
+    } while (elapsed < 0.2);
+    rfft_free(&fft);
+    return 1e6 * elapsed / runs;
+}
+
+static int bench_fft(int argc, char** argv)
+{
+    static const int default_rates[] = { 8000, 11025, 12000, 16000, 22050, 24000, 44100, 48000 };
+    int num_rates = (argc > 0) ? argc : (int)(sizeof(default_rates) / sizeof(default_rates[0]));
+
+    printf("%-6s %-5s %6s %-26s", "rate", "mode", "nfft", "factors of nfft/2");
+    for (int b = 0; b < RFFT_NUM_BACKENDS; ++b)
+        if (rfft_available((rfft_backend_t)b))
+            printf(" %8s us", rfft_backend_name((rfft_backend_t)b));
+    printf("  ms/slot\n");
+
+    for (int r = 0; r < num_rates; ++r)
+    {
+        int rate = (argc > 0) ? atoi(argv[r]) : default_rates[r];
+        for (int is_ft8 = 1; is_ft8 >= 0; --is_ft8)
+        {
+            float symbol_period = is_ft8 ? FT8_SYMBOL_PERIOD : FT4_SYMBOL_PERIOD;
+            float slot_time = is_ft8 ? FT8_SLOT_TIME : FT4_SLOT_TIME;
+            int block_size = (int)(rate * symbol_period);
+            int nfft = block_size * FREQ_OSR;
+            char factors[64];
+            int largest = rfft_factorize(nfft, factors, sizeof(factors));
+
+            // The decoder computes time_osr (2) frames per symbol over the whole slot
+            int frames_per_slot = TIME_OSR * (int)(slot_time / symbol_period);
+            double best = -1;
+
+            printf("%-6d %-5s %6d %-26s", rate, is_ft8 ? "FT8" : "FT4", nfft, factors);
+            for (int b = 0; b < RFFT_NUM_BACKENDS; ++b)
+            {
+                if (!rfft_available((rfft_backend_t)b))
+                    continue;
+                double us = time_rfft(nfft, (rfft_backend_t)b);
+                printf(" %11.1f", us);
+                if (best < 0 || us < best)
+                    best = us;
+            }
+            printf("  %7.1f%s\n", 1e-3 * best * frames_per_slot, largest > 5 ? "  <- awkward size" : "");
+        }
+    }
+    return 0;
+}
+
+// Fill the decoder's waterfall from a WAV file the same way process_buffer() does
+static bool load_waterfall(const char* path, bool is_ft8, ft8_decoder_t* dec)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+    wav_reader_t wav;
+    int rc = wav_open(&wav, fd, path);
+    close(fd); // The mapping stays
+    if (rc != 0 || !decoder_init(dec, wav.sample_rate, is_ft8))
+    {
+        wav_close(&wav);
+        return false;
+    }
+    float block[dec->mon.block_size];
+    while (!decoder_full(dec) && wav_read(&wav, block, dec->mon.block_size) == dec->mon.block_size) // Whole blocks only
+        decoder_feed(dec, block, dec->mon.block_size);
+    wav_close(&wav);
+    return true;
+}
+
+// Decode every candidate; returns the number of distinct messages, whose texts go in texts[]
+static int decode_all(const waterfall_t* wf, const candidate_t* cands, int num_cands, char (*texts)[35])
+{
+    message_t found[num_cands > 0 ? num_cands : 1];
+    int num_texts = 0;
+    for (int i = 0; i < num_cands; ++i)
+    {
+        message_t* message = &found[num_texts];
+        decode_status_t status;
+        if (!ft8_decode(wf, &cands[i], message, 20, &status))
+            continue;
+        int j;
+        for (j = 0; j < num_texts; ++j)
+            if (ft8_same_message(&found[j], message))
+                break;
+        if (j == num_texts && ft8_unpack_message(message, &status))
+            strcpy(texts[num_texts++], message->text);
+    }
+    return num_texts;
+}
+
+static bool same_candidate(const candidate_t* a, const candidate_t* b)
+{
+    return a->time_offset == b->time_offset && a->freq_offset == b->freq_offset && a->time_sub == b->time_sub && a->freq_sub == b->freq_sub;
+}
+
+static int bench_sync(int argc, char** argv)
+{
+    bool is_ft8 = true;
+    int num_survivors = 0;
+    int threads = 1;
+    int total_cands = 0, total_found = 0, total_msgs = 0, total_kept = 0;
+    int num_files = 0, num_identical = 0;
+    double total_exhaustive = 0, total_coarse = 0, total_parallel = 0;
+
+    printf("%-28s %10s %10s %12s %12s\n", "file", "full ms", "coarse ms", "candidates", "decodes");
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-4") == 0)
+        {
+            is_ft8 = false;
+            continue;
+        }
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            num_survivors = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+            continue;
+        }
+        ft8_decoder_t dec;
+        if (!load_waterfall(argv[i], is_ft8, &dec))
+            continue;
+        const waterfall_t* wf = &dec.mon.wf;
+        const int size = dec.candidate_size;
+        candidate_t* full = malloc(sizeof(candidate_t) * size);
+        candidate_t* coarse = malloc(sizeof(candidate_t) * size);
+        int num_full = 0, num_coarse = 0, runs;
+        double start;
+
+        start = now_sec();
+        for (runs = 0; runs < 3 || now_sec() - start < 0.2; ++runs)
+            num_full = ft8_find_sync(wf, size, full, 10);
+        double ms_full = 1e3 * (now_sec() - start) / runs;
+
+        start = now_sec();
+        for (runs = 0; runs < 3 || now_sec() - start < 0.2; ++runs)
+            num_coarse = ft8_find_sync_coarse(wf, size, coarse, 10, num_survivors);
+        double ms_coarse = 1e3 * (now_sec() - start) / runs;
+
+        if (threads > 1)
+        {
+            candidate_t* parallel = malloc(sizeof(candidate_t) * size);
+            int num_parallel = 0;
+            start = now_sec();
+            for (runs = 0; runs < 3 || now_sec() - start < 0.2; ++runs)
+                num_parallel = find_sync_parallel(wf, size, parallel, 10, threads);
+            total_parallel += 1e3 * (now_sec() - start) / runs;
+            ++num_files;
+            if (num_parallel == num_full && memcmp(parallel, full, sizeof(candidate_t) * num_full) == 0)
+                ++num_identical;
+            free(parallel);
+        }
+
+        int found = 0;
+        for (int a = 0; a < num_full; ++a)
+            for (int b = 0; b < num_coarse; ++b)
+                if (same_candidate(&full[a], &coarse[b]))
+                {
+                    ++found;
+                    break;
+                }
+
+        char (*texts_full)[35] = malloc(sizeof(*texts_full) * size);
+        char (*texts_coarse)[35] = malloc(sizeof(*texts_coarse) * size);
+        int msgs_full = decode_all(wf, full, num_full, texts_full);
+        int msgs_coarse = decode_all(wf, coarse, num_coarse, texts_coarse);
+        int kept = 0;
+        for (int a = 0; a < msgs_full; ++a)
+            for (int b = 0; b < msgs_coarse; ++b)
+                if (strcmp(texts_full[a], texts_coarse[b]) == 0)
+                {
+                    ++kept;
+                    break;
+                }
+
+        const char* name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%-28s %10.2f %10.2f %5d/%-6d %5d/%-6d\n", name, ms_full, ms_coarse, found, num_full, kept, msgs_full);
+        total_exhaustive += ms_full;
+        total_coarse += ms_coarse;
+        total_cands += num_full;
+        total_found += found;
+        total_msgs += msgs_full;
+        total_kept += kept;
+
+        free(texts_full);
+        free(texts_coarse);
+        free(full);
+        free(coarse);
+        decoder_free(&dec);
+    }
+    if (total_cands == 0)
+        return 1;
+    printf("Total: %.1f ms exhaustive, %.1f ms coarse (%.1fx); candidate recall %.1f%%, decode recall %.1f%% (%d/%d)\n",
+           total_exhaustive, total_coarse, total_exhaustive / total_coarse,
+           100.0 * total_found / total_cands, total_msgs ? 100.0 * total_kept / total_msgs : 100.0, total_kept, total_msgs);
+    if (num_files > 0)
+        printf("Exhaustive on %d threads: %.1f ms (%.2fx), same candidate list on %d/%d files\n",
+               threads, total_parallel, total_exhaustive / total_parallel, num_identical, num_files);
+    return 0;
+}
+
+// ft8_extract_logl() as it was before it was vectorized, one symbol at a time, for checking and timing against
+static void extract_logl_scalar(const waterfall_t* wf, const candidate_t* cand, float log174[])
+{
+    const bool is_ft4 = (wf->protocol == PROTO_FT4);
+    const int num_bits = is_ft4 ? 2 : 3;
+    const int num_tones = 1 << num_bits;
+    const int num_data = is_ft4 ? FT4_ND : FT8_ND;
+    const uint8_t* gray_map = is_ft4 ? kFT4_Gray_map : kFT8_Gray_map;
+    int offset = (((cand->time_offset * wf->time_osr) + cand->time_sub) * wf->freq_osr + cand->freq_sub) * wf->num_bins + cand->freq_offset;
+    const uint8_t* mag_cand = wf->mag + offset;
+
+    for (int k = 0; k < num_data; ++k)
+    {
+        int sym_idx = is_ft4 ? k + ((k < 29) ? 5 : ((k < 58) ? 9 : 13)) : k + ((k < 29) ? 7 : 14);
+        int block = cand->time_offset + sym_idx;
+        float* logl = log174 + num_bits * k;
+        if ((block < 0) || (block >= wf->num_blocks))
+        {
+            for (int b = 0; b < num_bits; ++b)
+                logl[b] = 0;
+            continue;
+        }
+        const uint8_t* ps = mag_cand + (sym_idx * wf->block_stride);
+        float s2[8];
+        for (int j = 0; j < num_tones; ++j)
+            s2[j] = (float)ps[gray_map[j]];
+        for (int b = 0; b < num_bits; ++b)
+        {
+            const int mask = num_tones >> (b + 1);
+            float max_one = -1000, max_zero = -1000;
+            for (int j = 0; j < num_tones; ++j)
+            {
+                if (j & mask)
+                    max_one = (max_one >= s2[j]) ? max_one : s2[j];
+                else
+                    max_zero = (max_zero >= s2[j]) ? max_zero : s2[j];
+            }
+            logl[b] = max_one - max_zero;
+        }
+    }
+
+    float sum = 0;
+    float sum2 = 0;
+    for (int i = 0; i < FTX_LDPC_N; ++i)
+    {
+        sum += log174[i];
+        sum2 += log174[i] * log174[i];
+    }
+    float inv_n = 1.0f / FTX_LDPC_N;
+    float variance = (sum2 - (sum * sum * inv_n)) * inv_n;
+    float norm_factor = sqrtf(24.0f / variance);
+    for (int i = 0; i < FTX_LDPC_N; ++i)
+        log174[i] *= norm_factor;
+}
+
+static int bench_llr(int argc, char** argv)
+{
+    bool is_ft8 = true;
+    const char* names[2] = { "scalar", "vectorized" };
+    double total_ms[2] = { 0 };
+    long total_cands = 0, total_differ[2] = { 0 };
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-4") == 0)
+        {
+            is_ft8 = false;
+            continue;
+        }
+        ft8_decoder_t dec;
+        if (!load_waterfall(argv[i], is_ft8, &dec))
+            continue;
+        const waterfall_t* wf = &dec.mon.wf;
+        candidate_t* cands = malloc(sizeof(candidate_t) * dec.candidate_size);
+        const int num_cands = ft8_find_sync(wf, dec.candidate_size, cands, 10);
+        float(*llr)[FTX_LDPC_N] = malloc(sizeof(*llr) * 2 * (num_cands + 1));
+
+        for (int m = 0; m < 2; ++m)
+        {
+            float(*out)[FTX_LDPC_N] = llr + m * num_cands;
+            double start = now_sec();
+            int runs;
+            for (runs = 0; runs < 3 || now_sec() - start < 0.1; ++runs)
+            {
+                for (int c = 0; c < num_cands; ++c)
+                {
+                    if (m == 0)
+                        extract_logl_scalar(wf, &cands[c], out[c]);
+                    else
+                        ft8_extract_logl(wf, &cands[c], out[c]);
+                }
+            }
+            total_ms[m] += 1e3 * (now_sec() - start) / runs;
+            for (int c = 0; c < num_cands; ++c)
+                total_differ[m] += memcmp(out[c], llr[c], sizeof(llr[c])) != 0;
+        }
+        total_cands += num_cands;
+        free(llr);
+        free(cands);
+        decoder_free(&dec);
+    }
+    if (total_cands == 0)
+        return 1;
+    printf("%-12s %12s %12s %14s\n", "extraction", "ms total", "ns/cand", "differing");
+    for (int m = 0; m < 2; ++m)
+        printf("%-12s %12.2f %12.1f %8ld/%-6ld\n", names[m], total_ms[m], 1e6 * total_ms[m] / total_cands, total_differ[m], total_cands);
+    return 0;
+}
+
+// Random valid codeword: a random 77-bit payload through ft8_encode(), with the data symbols Gray decoded back to bits
+static void random_codeword(uint8_t bits[FTX_LDPC_N])
+{
+    uint8_t payload[10];
+    uint8_t tones[FT8_NN];
+    for (int i = 0; i < 10; ++i)
+        payload[i] = rand();
+    payload[9] &= 0xF8;
+    ft8_encode(payload, tones);
+
+    int k = 0;
+    for (int i = 0; i < FT8_NN; ++i)
+    {
+        if (i < 7 || (i >= 36 && i < 43) || i >= 72)
+            continue; // Costas sync
+        int bits3 = 0;
+        while (kFT8_Gray_map[bits3] != tones[i])
+            ++bits3;
+        bits[k++] = (bits3 >> 2) & 1;
+        bits[k++] = (bits3 >> 1) & 1;
+        bits[k++] = bits3 & 1;
+    }
+}
+
+static float gaussian(void)
+{
+    float u1 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+    float u2 = (float)rand() / RAND_MAX;
+    return sqrtf(-2 * logf(u1)) * cosf(2 * (float)M_PI * u2);
+}
+
+// Count successful decodes (no parity errors) and, in *correct, those that gave back the transmitted bits
+static int count_ok(const uint8_t (*bits)[FTX_LDPC_N], const uint8_t (*plain)[FTX_LDPC_N], const int* ok, int count, int* correct)
+{
+    int num_ok = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (ok[i] != 0)
+            continue;
+        ++num_ok;
+        if (memcmp(bits[i], plain[i], FTX_LDPC_N) == 0)
+            ++*correct;
+    }
+    return num_ok;
+}
+
+// The byte-per-bit primitives the packed ones replaced, for checking and timing against
+static int check_bytes(const uint8_t codeword[])
+{
+    int errors = 0;
+    for (int m = 0; m < FTX_LDPC_M; ++m)
+    {
+        uint8_t x = 0;
+        for (int i = 0; i < kFTX_LDPC_Num_rows[m]; ++i)
+            x ^= codeword[kFTX_LDPC_Nm[m][i] - 1];
+        errors += (x != 0);
+    }
+    return errors;
+}
+
+static void pack_bytes(const uint8_t bit_array[], int num_bits, uint8_t packed[])
+{
+    memset(packed, 0, (num_bits + 7) / 8);
+    for (int i = 0; i < num_bits; ++i)
+        if (bit_array[i])
+            packed[i / 8] |= 0x80 >> (i % 8);
+}
+
+static uint16_t crc_bitwise(const uint8_t message[], int num_bits)
+{
+    uint16_t remainder = 0;
+    for (int idx_bit = 0; idx_bit < num_bits; ++idx_bit)
+    {
+        if (idx_bit % 8 == 0)
+            remainder ^= (message[idx_bit / 8] << (FT8_CRC_WIDTH - 8));
+        remainder = (remainder & (1u << (FT8_CRC_WIDTH - 1))) ? (remainder << 1) ^ FT8_CRC_POLYNOMIAL : (remainder << 1);
+    }
+    return remainder & ((1u << FT8_CRC_WIDTH) - 1u);
+}
+
+static int bench_bits(int argc, char** argv)
+{
+    int num_codewords = 1000;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            num_codewords = atoi(argv[++i]);
+    }
+    if (num_codewords < 1)
+        return 1;
+
+    // Codewords with 0 to 3 bits flipped, so the checks see both outcomes
+    srand(1);
+    uint8_t(*plain)[FTX_LDPC_N] = malloc(sizeof(*plain) * num_codewords);
+    codeword174_t* packed = malloc(sizeof(*packed) * num_codewords);
+    uint8_t(*bytes)[FTX_LDPC_K_BYTES + 1] = malloc(sizeof(*bytes) * num_codewords);
+    for (int c = 0; c < num_codewords; ++c)
+    {
+        random_codeword(plain[c]);
+        for (int f = c % 4; f > 0; --f)
+            plain[c][rand() % FTX_LDPC_N] ^= 1;
+        ldpc_pack(plain[c], &packed[c]);
+        pack_bytes(plain[c], FTX_LDPC_K, bytes[c]);
+    }
+
+    int mismatches[3] = { 0 };
+    for (int c = 0; c < num_codewords; ++c)
+    {
+        mismatches[0] += check_bytes(plain[c]) != ldpc_check_packed(&packed[c]);
+        for (int i = 0; i < FTX_LDPC_K_BYTES; ++i)
+            mismatches[1] += bytes[c][i] != (uint8_t)(packed[c].w[i / 8] >> (56 - 8 * (i % 8))) && i < FTX_LDPC_K_BYTES - 1;
+        for (int num_bits = 1; num_bits <= FTX_LDPC_K; num_bits += 9)
+            mismatches[2] += crc_bitwise(bytes[c], num_bits) != ftx_compute_crc(bytes[c], num_bits);
+    }
+
+    // Each primitive as it runs per LDPC iteration or per candidate
+    volatile int sink = 0;
+    double ns[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        double start = now_sec();
+        int runs;
+        for (runs = 0; runs < 3 || now_sec() - start < 0.2; ++runs)
+        {
+            for (int c = 0; c < num_codewords; ++c)
+            {
+                switch (p)
+                {
+                case 0: sink += check_bytes(plain[c]); break;
+                case 1: sink += ldpc_check_packed(&packed[c]); break;
+                case 2: pack_bytes(plain[c], FTX_LDPC_K, bytes[c]); sink += bytes[c][0]; break;
+                case 3: ldpc_pack(plain[c], &packed[c]); sink += (int)packed[c].w[0]; break;
+                case 4: sink += crc_bitwise(bytes[c], 96 - 14); break;
+                case 5: sink += ftx_compute_crc(bytes[c], 96 - 14); break;
+                }
+            }
+        }
+        ns[p] = 1e9 * (now_sec() - start) / runs / num_codewords;
+    }
+    (void)sink;
+
+    printf("%-34s %12s %12s %8s %10s\n", "primitive", "before ns", "now ns", "speedup", "mismatch");
+    printf("%-34s %12.1f %12.1f %7.1fx %10d\n", "parity checks (83)", ns[0], ns[1], ns[0] / ns[1], mismatches[0]);
+    printf("%-34s %12.1f %12.1f %7.1fx %10d\n", "packing hard decisions", ns[2], ns[3], ns[2] / ns[3], mismatches[1]);
+    printf("%-34s %12.1f %12.1f %7.1fx %10d\n", "CRC-14 of 82 bits", ns[4], ns[5], ns[4] / ns[5], mismatches[2]);
+    printf("(packing: 91 bits into bytes before, all 174 into words now)\n");
+
+    free(bytes);
+    free(packed);
+    free(plain);
+    return 0;
+}
+
+// One thread's share of the hash store benchmark: save its callsigns, then look up the hashes of the last ones
+struct hashcall_job
+{
+    char (*calls)[12];
+    int count;
+    int recent; // Lookups of the last this many callsigns saved
+    double save_ns, lookup_ns;
+    int found[2], wrong; // Callsigns resolved by 22 and by 12 bits, and callsigns found with another hash
+};
+
+static void* hashcall_worker(void* arg)
+{
+    struct hashcall_job* job = arg;
+    double start = now_sec();
+    for (int i = 0; i < job->count; ++i)
+        hashcall_save(job->calls[i]);
+    job->save_ns = 1e9 * (now_sec() - start) / job->count;
+
+    // Even entries by their 22-bit hash, odd ones by their 12-bit hash
+    const int first = job->count - job->recent;
+    uint32_t* hashes = malloc(sizeof(hashes[0]) * job->recent);
+    char(*found)[12] = malloc(sizeof(*found) * job->recent);
+    for (int i = 0; i < job->recent; ++i)
+        hashcall_compute(job->calls[first + i], (i % 2) ? 12 : 22, &hashes[i]);
+    start = now_sec();
+    for (int i = 0; i < job->recent; ++i)
+    {
+        if (!hashcall_lookup(hashes[i], (i % 2) ? 12 : 22, found[i]))
+            found[i][0] = '\0';
+    }
+    job->lookup_ns = 1e9 * (now_sec() - start) / job->recent;
+
+    for (int i = 0; i < job->recent; ++i)
+    {
+        uint32_t check;
+        if (found[i][0] == '\0')
+            continue;
+        job->found[i % 2] += strcmp(found[i], job->calls[first + i]) == 0;
+        job->wrong += !hashcall_compute(found[i], (i % 2) ? 12 : 22, &check) || check != hashes[i];
+    }
+    free(found);
+    free(hashes);
+    return NULL;
+}
+
+static int bench_hashcall(int argc, char** argv)
+{
+    int num_calls = 100000;
+    int threads = 1;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            num_calls = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+    }
+    if (threads < 1)
+        threads = 1;
+    if (num_calls < 2 * threads)
+        return 1;
+
+    // Random standard callsigns: letter, letter or digit, digit, one to three letters
+    const int capacity = (1 << HASHCALL_SET_BITS) * HASHCALL_WAYS;
+    srand(1);
+    char(*calls)[12] = malloc(sizeof(*calls) * num_calls);
+    for (int i = 0; i < num_calls; ++i)
+    {
+        char* c = calls[i];
+        *c++ = 'A' + rand() % 26;
+        *c++ = (rand() % 2) ? 'A' + rand() % 26 : '0' + rand() % 10;
+        *c++ = '0' + rand() % 10;
+        for (int n = 1 + rand() % 3; n > 0; --n)
+            *c++ = 'A' + rand() % 26;
+        *c = '\0';
+    }
+
+    hashcall_clear();
+    struct hashcall_job jobs[threads];
+    pthread_t tids[threads];
+    bool started[threads];
+    const int share = num_calls / threads;
+    // Together the threads look up about half as many recent callsigns as the store holds
+    const int recent = capacity / 2 / threads < share ? capacity / 2 / threads : share;
+    for (int t = 0; t < threads; ++t)
+    {
+        jobs[t] = (struct hashcall_job){ .calls = calls + t * share, .count = share, .recent = recent };
+        started[t] = pthread_create(&tids[t], NULL, hashcall_worker, &jobs[t]) == 0;
+        if (!started[t])
+            hashcall_worker(&jobs[t]);
+    }
+    double save_ns = 0, lookup_ns = 0;
+    int found[2] = { 0 }, wrong = 0;
+    for (int t = 0; t < threads; ++t)
+    {
+        if (started[t])
+            pthread_join(tids[t], NULL);
+        save_ns += jobs[t].save_ns / threads;
+        lookup_ns += jobs[t].lookup_ns / threads;
+        found[0] += jobs[t].found[0];
+        found[1] += jobs[t].found[1];
+        wrong += jobs[t].wrong;
+    }
+    const int lookups = recent * threads;
+
+    printf("%d callsigns saved on %d thread(s) into a store of %d: %.1f ns per save\n", num_calls, threads, capacity, save_ns);
+    printf("%d lookups of recent callsigns: %.1f ns each, %d with the wrong hash\n", lookups, lookup_ns, wrong);
+    printf("resolved to the callsign saved: %.1f%% by 22-bit hash, %.1f%% by 12-bit hash (ambiguous once the store holds\n"
+           "more callsigns than 12 bits can tell apart)\n",
+           100.0 * found[0] / (lookups - lookups / 2), 100.0 * found[1] / (lookups / 2));
+    free(calls);
+    return wrong == 0 ? 0 : 1;
+}
+
+static int bench_ldpc(int argc, char** argv)
+{
+    static const float sigmas[] = { 0.6f, 0.7f, 0.8f, 0.9f, 1.0f };
+    int max_iters = 20; // As in decode_ft8
+    int num_codewords = 2000;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            max_iters = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            num_codewords = atoi(argv[++i]);
+    }
+    if (num_codewords <= 0 || max_iters <= 0)
+        return 1;
+
+    uint8_t (*bits)[FTX_LDPC_N] = malloc(sizeof(*bits) * num_codewords);
+    float (*llr)[FTX_LDPC_N] = malloc(sizeof(*llr) * num_codewords);
+    uint8_t (*plain)[FTX_LDPC_N] = malloc(sizeof(*plain) * num_codewords);
+    uint8_t (*plain_batch)[FTX_LDPC_N] = malloc(sizeof(*plain_batch) * num_codewords);
+    int* ok = malloc(sizeof(int) * num_codewords);
+    int* ok_batch = malloc(sizeof(int) * num_codewords);
+    int* iters = malloc(sizeof(int) * num_codewords);
+    int* iters_layered = malloc(sizeof(int) * num_codewords);
+
+    printf("%d codewords per noise level, %d iterations, %d lanes\n", num_codewords, max_iters, FTX_LDPC_LANES);
+    printf("%-6s %20s %20s %20s %20s %10s %12s\n", "sigma", "ldpc_decode ok/us", "bp_decode ok/us", "batch ok/us", "layered ok/us", "identical", "iter bp/lyr");
+    srand(1);
+    for (int s = 0; s < (int)(sizeof(sigmas) / sizeof(sigmas[0])); ++s)
+    {
+        // BPSK, with positive log-likelihoods for ones as ft8_decode() delivers them
+        const float sigma = sigmas[s];
+        for (int i = 0; i < num_codewords; ++i)
+        {
+            random_codeword(bits[i]);
+            for (int k = 0; k < FTX_LDPC_N; ++k)
+                llr[i][k] = 2 * ((bits[i][k] ? 1.0f : -1.0f) + sigma * gaussian()) / (sigma * sigma);
+        }
+        int correct[4] = { 0 };
+        double start;
+
+        start = now_sec();
+        for (int i = 0; i < num_codewords; ++i)
+            ldpc_decode(llr[i], max_iters, plain[i], &ok[i]);
+        double us_ldpc = 1e6 * (now_sec() - start) / num_codewords;
+        int ok_ldpc = count_ok((const uint8_t (*)[FTX_LDPC_N])bits, (const uint8_t (*)[FTX_LDPC_N])plain, ok, num_codewords, &correct[0]);
+
+        start = now_sec();
+        for (int i = 0; i < num_codewords; ++i)
+            bp_decode(llr[i], max_iters, plain[i], &ok[i]);
+        double us_bp = 1e6 * (now_sec() - start) / num_codewords;
+        int ok_bp = count_ok((const uint8_t (*)[FTX_LDPC_N])bits, (const uint8_t (*)[FTX_LDPC_N])plain, ok, num_codewords, &correct[1]);
+
+        start = now_sec();
+        bp_decode_batch(llr, num_codewords, max_iters, plain_batch, ok_batch, iters);
+        double us_batch = 1e6 * (now_sec() - start) / num_codewords;
+        int ok_batch_count = count_ok((const uint8_t (*)[FTX_LDPC_N])bits, (const uint8_t (*)[FTX_LDPC_N])plain_batch, ok_batch, num_codewords, &correct[2]);
+
+        int same = 0;
+        for (int i = 0; i < num_codewords; ++i)
+        {
+            if (ok[i] == ok_batch[i] && memcmp(plain[i], plain_batch[i], FTX_LDPC_N) == 0)
+                ++same;
+        }
+
+        start = now_sec();
+        for (int i = 0; i < num_codewords; ++i)
+            ldpc_decode_layered(llr[i], max_iters, plain[i], &ok[i], &iters_layered[i]);
+        double us_layered = 1e6 * (now_sec() - start) / num_codewords;
+        int ok_layered = count_ok((const uint8_t (*)[FTX_LDPC_N])bits, (const uint8_t (*)[FTX_LDPC_N])plain, ok, num_codewords, &correct[3]);
+
+        // Mean message passing rounds over the codewords both decoded
+        long total_iters = 0, total_layered = 0;
+        int both = 0;
+        for (int i = 0; i < num_codewords; ++i)
+        {
+            if (ok[i] == 0 && ok_batch[i] == 0)
+            {
+                total_iters += iters[i];
+                total_layered += iters_layered[i];
+                ++both;
+            }
+        }
+
+        printf("%-6.2f %11.1f%% %7.2f %11.1f%% %7.2f %11.1f%% %7.2f %11.1f%% %7.2f %9.1f%% %5.1f/%-5.1f\n", sigma,
+               100.0 * ok_ldpc / num_codewords, us_ldpc, 100.0 * ok_bp / num_codewords, us_bp,
+               100.0 * ok_batch_count / num_codewords, us_batch, 100.0 * ok_layered / num_codewords, us_layered,
+               100.0 * same / num_codewords, both ? (double)total_iters / both : 0.0, both ? (double)total_layered / both : 0.0);
+        if (correct[0] != ok_ldpc || correct[1] != ok_bp || correct[2] != ok_batch_count || correct[3] != ok_layered)
+            printf("       undetected errors: %d %d %d %d\n", ok_ldpc - correct[0], ok_bp - correct[1], ok_batch_count - correct[2], ok_layered - correct[3]);
+    }
+    free(bits);
+    free(llr);
+    free(plain);
+    free(plain_batch);
+    free(ok);
+    free(ok_batch);
+    free(iters);
+    free(iters_layered);
+    return 0;
+}
+
+// Does the 91-bit message at the front of a 174-bit codeword carry a good CRC?
+static bool crc_ok(const uint8_t plain[])
+{
+    uint8_t a91[FTX_LDPC_K_BYTES] = { 0 };
+    for (int i = 0; i < FTX_LDPC_K; ++i)
+        if (plain[i])
+            a91[i / 8] |= 0x80u >> (i % 8);
+    uint16_t crc = ftx_extract_crc(a91);
+    a91[9] &= 0xF8;
+    a91[10] = 0;
+    return crc == ftx_compute_crc(a91, 96 - 14);
+}
+
+static int bench_osd(int argc, char** argv)
+{
+    static const float sigmas[] = { 0.8f, 0.9f, 1.0f, 1.1f };
+    int num_codewords = 1000;
+    int max_errors = FTX_LDPC_M; // BP near-miss gate
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            num_codewords = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            max_errors = atoi(argv[++i]);
+    }
+    if (num_codewords <= 0)
+        return 1;
+
+    uint8_t (*bits)[FTX_LDPC_N] = malloc(sizeof(*bits) * num_codewords);
+    float (*llr)[FTX_LDPC_N] = malloc(sizeof(*llr) * num_codewords);
+    uint8_t (*plain)[FTX_LDPC_N] = malloc(sizeof(*plain) * num_codewords);
+    int* ok = malloc(sizeof(int) * num_codewords);
+
+    printf("%d codewords per noise level, 20 BP iterations, OSD on BP failures with at most %d parity errors\n", num_codewords, max_errors);
+    printf("%-6s %8s %8s | %-35s | %-35s\n", "sigma", "BP", "BP us", "  BP + OSD-1: ok  false   tried  us", "  BP + OSD-2: ok  false   tried  us");
+    srand(1);
+    for (int s = 0; s < (int)(sizeof(sigmas) / sizeof(sigmas[0])); ++s)
+    {
+        const float sigma = sigmas[s];
+        for (int i = 0; i < num_codewords; ++i)
+        {
+            random_codeword(bits[i]);
+            for (int k = 0; k < FTX_LDPC_N; ++k)
+                llr[i][k] = 2 * ((bits[i][k] ? 1.0f : -1.0f) + sigma * gaussian()) / (sigma * sigma);
+        }
+        double start = now_sec();
+        bp_decode_batch(llr, num_codewords, 20, plain, ok, NULL);
+        double us_bp = 1e6 * (now_sec() - start) / num_codewords;
+        int bp_good = 0;
+        for (int i = 0; i < num_codewords; ++i)
+            if (ok[i] == 0 && crc_ok(plain[i]) && memcmp(plain[i], bits[i], FTX_LDPC_N) == 0)
+                ++bp_good;
+        printf("%-6.2f %7.1f%% %8.1f |", sigma, 100.0 * bp_good / num_codewords, us_bp);
+
+        for (int depth = 1; depth <= 2; ++depth)
+        {
+            int good = 0, bad = 0, tried = 0;
+            start = now_sec();
+            for (int i = 0; i < num_codewords; ++i)
+            {
+                if (ok[i] == 0 || ok[i] > max_errors)
+                    continue;
+                uint8_t osd_plain[FTX_LDPC_N];
+                osd_decode(llr[i], depth, osd_plain, NULL);
+                ++tried;
+                if (!crc_ok(osd_plain))
+                    continue;
+                if (memcmp(osd_plain, bits[i], FTX_LDPC_N) == 0)
+                    ++good;
+                else
+                    ++bad;
+            }
+            double us = tried ? 1e6 * (now_sec() - start) / tried : 0;
+            printf("   %17.1f%% %6d %7d %5.0f |", 100.0 * (bp_good + good) / num_codewords, bad, tried, us);
+        }
+        printf("\n");
+    }
+    free(bits);
+    free(llr);
+    free(plain);
+    free(ok);
+    return 0;
+}
+
+// Payloads of the synthesized signals; returns how many of the decoder's messages are among them (*wrong the rest)
+static int count_found(const ft8_decoder_t* dec, const uint8_t (*payloads)[10], int num_payloads, int* wrong)
+{
+    int found = 0;
+    *wrong = 0;
+    for (int i = 0; i < kMax_decoded_messages; ++i)
+    {
+        const message_t* msg = dec->decoded_hashtable[i];
+        if (msg == NULL)
+            continue;
+        int j = 0;
+        while (j < num_payloads && memcmp(payloads[j], msg->payload, 10) != 0)
+            ++j;
+        if (j < num_payloads)
+            ++found;
+        else
+            ++(*wrong);
+    }
+    return found;
+}
+
+static int bench_ddc(int argc, char** argv)
+{
+    int rate = 48000;
+    int num_bands = 4;
+    int per_band = 8;
+    float snr = -12;
+    const char* wav_path = NULL;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            num_bands = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            per_band = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            snr = atof(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            wav_path = argv[++i];
+    }
+    // 5 kHz bands from 1 kHz up, as many as fit below the capture's Nyquist frequency
+    const float band_width = 5000;
+    if (num_bands > (int)((rate / 2 - 1000) / band_width))
+        num_bands = (int)((rate / 2 - 1000) / band_width);
+    if (num_bands < 1 || per_band < 1 || rate % 12000 != 0)
+    {
+        fprintf(stderr, "Need a multiple of 12 kHz with room for a 5 kHz band above 1 kHz\n");
+        return 1;
+    }
+
+    // One slot of white noise (sigma 0.01) with per_band FT8 signals spread over each band, SNR in 2500 Hz
+    const int num_samples = (int)(FT8_SLOT_TIME * rate);
+    float* signal = calloc(num_samples, sizeof(float));
+    float* wave = malloc(sizeof(float) * FT8_NN * (int)(FT8_SYMBOL_PERIOD * rate + 0.5f));
+    const int num_signals = num_bands * per_band;
+    uint8_t (*payloads)[10] = calloc(num_signals, sizeof(*payloads));
+    const float sigma = 0.01f;
+    const float amplitude = sigma * sqrtf(2 * powf(10, snr / 10) * 2500 / (rate / 2));
+    srand(1);
+    for (int i = 0; i < num_samples; ++i)
+        signal[i] = sigma * gaussian();
+    for (int s = 0; s < num_signals; ++s)
+    {
+        const int band = s / per_band, slot = s % per_band;
+        const float low = 1000 + band * band_width;
+        const float freq = low + 300 + slot * (band_width - 700) / per_band + rand() % 20;
+        char text[32];
+        snprintf(text, sizeof(text), "CQ K%dA%c%c FN%d%d", s % 10, 'A' + (s / 10) % 26, 'A' + s % 26, s % 10, (s / 10) % 10);
+        uint8_t tones[FT8_NN];
+        pack77(text, payloads[s]);
+        ft8_encode(payloads[s], tones);
+        synth_gfsk(tones, FT8_NN, freq, FT8_SYMBOL_BT, FT8_SYMBOL_PERIOD, rate, wave);
+        const int start = (int)((0.3f + 0.4f * rand() / RAND_MAX) * rate);
+        const int len = FT8_NN * (int)(FT8_SYMBOL_PERIOD * rate + 0.5f);
+        for (int i = 0; i < len && start + i < num_samples; ++i)
+            signal[start + i] += amplitude * wave[i];
+    }
+    free(wave);
+    if (wav_path != NULL)
+        save_wav(signal, num_samples, rate, wav_path);
+    printf("%d Hz, %d bands of %.0f Hz from 1 kHz, %d signals each at %.0f dB SNR\n", rate, num_bands, band_width, per_band, snr);
+    printf("%-34s %10s %10s %10s %8s\n", "", "total ms", "DDC ms", "decoded", "false");
+
+    // Full rate, over the whole capture and over just the span of the bands
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        Freq_min = pass ? 1000 : 0;
+        Freq_max = pass ? 1000 + num_bands * band_width : 0;
+        double start = now_sec();
+        ft8_decoder_t dec;
+        if (!decoder_init(&dec, rate, true))
+            return 1;
+        for (int pos = 0; pos + dec.mon.block_size <= num_samples && !decoder_full(&dec); pos += dec.mon.block_size)
+            decoder_feed(&dec, signal + pos, dec.mon.block_size);
+        decoder_decode(&dec);
+        double ms = 1e3 * (now_sec() - start);
+        int wrong, found = count_found(&dec, payloads, num_signals, &wrong);
+        printf("%-34s %10.1f %10s %5d/%-4d %8d\n", pass ? "full rate, bands' span only (-b)" : "full rate, whole capture", ms, "", found, num_signals, wrong);
+        decoder_free(&dec);
+    }
+    Freq_min = Freq_max = 0;
+
+    // Every band down-converted to 12 kHz through one filter bank, then each decoded on its own
+    double start = now_sec();
+    ddc_t ddc;
+    if (!ddc_init(&ddc, rate, 12000, RFFT_NUM_BACKENDS))
+        return 1;
+    ddc_channel_t chans[num_bands];
+    ft8_decoder_t decs[num_bands];
+    for (int b = 0; b < num_bands; ++b)
+    {
+        const float low = 1000 + b * band_width;
+        if (!ddc_channel_init(&chans[b], &ddc, low, low + band_width)
+            || !decoder_init_band(&decs[b], 12000, true, low - chans[b].shift, low + band_width - chans[b].shift))
+            return 1;
+    }
+    float out[ddc.out_nfft / 2];
+    double ms_ddc = 0;
+    // Half a block of silence past the end flushes the filter bank
+    for (int pos = 0; pos < num_samples + ddc.nfft / 2 && !decoder_full(&decs[0]);)
+    {
+        double t = now_sec();
+        if (pos < num_samples)
+            pos += ddc_push(&ddc, signal + pos, num_samples - pos);
+        else
+        {
+            static const float zeros[4096];
+            pos += ddc_push(&ddc, zeros, 4096);
+        }
+        if (!ddc_ready(&ddc))
+            continue;
+        ddc_compute(&ddc);
+        for (int b = 0; b < num_bands; ++b)
+        {
+            int count = ddc_channel_output(&chans[b], &ddc, out);
+            ms_ddc += 1e3 * (now_sec() - t);
+            decoder_feed(&decs[b], out, count);
+            t = now_sec();
+        }
+    }
+    int found = 0, wrong = 0;
+    for (int b = 0; b < num_bands; ++b)
+    {
+        decoder_decode(&decs[b]);
+        int w;
+        found += count_found(&decs[b], payloads, num_signals, &w);
+        wrong += w;
+    }
+    double ms_total = 1e3 * (now_sec() - start);
+    for (int b = 0; b < num_bands; ++b)
+    {
+        decoder_free(&decs[b]);
+        ddc_channel_free(&chans[b]);
+    }
+    ddc_free(&ddc);
+    printf("%-34s %10.1f %10.1f %5d/%-4d %8d\n", "DDC to 12 kHz, bands decoded apart", ms_total, ms_ddc, found, num_signals, wrong);
+
+    free(payloads);
+    free(signal);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: bench_ft8 fft [sample_rate ...]\n");
+    fprintf(stderr, "       bench_ft8 sync [-4] [-n survivors] [-t threads] file.wav ...\n");
+    fprintf(stderr, "       bench_ft8 llr [-4] file.wav ...\n");
+    fprintf(stderr, "       bench_ft8 bits [-n codewords]\n");
+    fprintf(stderr, "       bench_ft8 hashcall [-n callsigns] [-t threads]\n");
+    fprintf(stderr, "       bench_ft8 ldpc [-i iterations] [-n codewords]\n");
+    fprintf(stderr, "       bench_ft8 osd [-n codewords] [-e max_errors]\n");
+    fprintf(stderr, "       bench_ft8 ddc [-r sample_rate] [-b bands] [-n signals] [-s snr] [-w file.wav]\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "fft") == 0)
+        return bench_fft(argc - 2, argv + 2);
+    if (strcmp(argv[1], "sync") == 0)
+        return bench_sync(argc - 2, argv + 2);
+    if (strcmp(argv[1], "llr") == 0)
+        return bench_llr(argc - 2, argv + 2);
+    if (strcmp(argv[1], "bits") == 0)
+        return bench_bits(argc - 2, argv + 2);
+    if (strcmp(argv[1], "hashcall") == 0)
+        return bench_hashcall(argc - 2, argv + 2);
+    if (strcmp(argv[1], "ldpc") == 0)
+        return bench_ldpc(argc - 2, argv + 2);
+    if (strcmp(argv[1], "osd") == 0)
+        return bench_osd(argc - 2, argv + 2);
+    if (strcmp(argv[1], "ddc") == 0)
+        return bench_ddc(argc - 2, argv + 2);
+
+    usage();
+    return 1;
+}
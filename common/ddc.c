@@ -0,0 +1,177 @@
+// Digital down-converter for wideband captures: sub-bands to low-rate real signals by fast convolution
+
+#include "ddc.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > 1e-12 * sum; ++k)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+bool ddc_init(ddc_t* me, int in_rate, int out_rate, rfft_backend_t backend)
+{
+    memset(me, 0, sizeof(*me));
+    const int out_nfft = (int)lrintf(out_rate * DDC_BLOCK_TIME);
+    // A multiple of 16 keeps the output mixing phase at a multiple of 2 pi from block to block
+    if (out_rate <= 0 || in_rate % out_rate != 0 || out_nfft % 16 != 0)
+        return false;
+
+    me->decim = in_rate / out_rate;
+    me->out_nfft = out_nfft;
+    me->nfft = me->decim * out_nfft;
+    me->bin_hz = (float)out_rate / out_nfft;
+    me->buffer = (float*)malloc(me->nfft * sizeof(me->buffer[0]));
+    if (me->buffer == NULL || !rfft_init(&me->fft, me->nfft, backend))
+    {
+        ddc_free(me);
+        return false;
+    }
+    ddc_reset(me);
+    return true;
+}
+
+void ddc_free(ddc_t* me)
+{
+    rfft_free(&me->fft);
+    free(me->buffer);
+    memset(me, 0, sizeof(*me));
+}
+
+void ddc_reset(ddc_t* me)
+{
+    // A quarter block of silence ahead of the input: each block's output is its middle half,
+    // so the first output sample lines up with the first input sample
+    me->fill = me->nfft / 4;
+    memset(me->buffer, 0, me->fill * sizeof(me->buffer[0]));
+    me->block = 0;
+}
+
+int ddc_push(ddc_t* me, const float* samples, int n)
+{
+    int count = me->nfft - me->fill;
+    if (count > n)
+        count = n;
+    memcpy(me->buffer + me->fill, samples, count * sizeof(samples[0]));
+    me->fill += count;
+    return count;
+}
+
+void ddc_compute(ddc_t* me)
+{
+    memcpy(me->fft.in, me->buffer, me->nfft * sizeof(me->buffer[0]));
+    rfft_execute(&me->fft);
+    ++me->block;
+
+    const int half = me->nfft / 2;
+    memmove(me->buffer, me->buffer + half, half * sizeof(me->buffer[0]));
+    me->fill = half;
+}
+
+bool ddc_channel_init(ddc_channel_t* me, const ddc_t* ddc, float low, float high)
+{
+    memset(me, 0, sizeof(*me));
+    const float in_rate = ddc->bin_hz * ddc->nfft;
+    const float out_rate = ddc->bin_hz * ddc->out_nfft;
+    if (low < 0 || high <= low || high > in_rate / 2 || high - low > out_rate / 2 - 2 * DDC_TRANSITION)
+        return false;
+
+    const int nfft = ddc->nfft;
+    const int out_bins = ddc->out_nfft / 4; // Either side of the centre
+    me->center_bin = (int)lrintf(0.5f * (low + high) / ddc->bin_hz);
+    me->shift = me->center_bin * ddc->bin_hz - out_rate / 4;
+    me->response = (float*)malloc((out_bins + 1) * sizeof(me->response[0]));
+    me->spectrum = (kiss_fft_cpx*)malloc((ddc->out_nfft / 2 + 1) * sizeof(me->spectrum[0]));
+    me->time = (kiss_fft_scalar*)malloc(ddc->out_nfft * sizeof(me->time[0]));
+    me->inverse = kiss_fftr_alloc(ddc->out_nfft, 1, NULL, NULL);
+    rfft_t design;
+    if (me->response == NULL || me->spectrum == NULL || me->time == NULL || me->inverse == NULL
+        || !rfft_init(&design, nfft, RFFT_KISS))
+    {
+        ddc_channel_free(me);
+        return false;
+    }
+
+    // Kaiser-windowed low-pass prototype, zero phase, cut off in the middle of the transition. Its
+    // support of nfft / 2 + 1 taps is what the overlap-save blocks leave room for; the band edges
+    // sit off the centre bin by up to half a bin, hence the extra margin
+    const double cutoff = 0.5 * (high - low) + 0.5 * ddc->bin_hz + 0.5 * DDC_TRANSITION;
+    const double beta = 0.1102 * (DDC_STOPBAND_DB - 8.7);
+    const double i0_beta = bessel_i0(beta);
+    const int half_taps = nfft / 4;
+    memset(design.in, 0, nfft * sizeof(design.in[0]));
+    for (int k = -half_taps; k <= half_taps; ++k)
+    {
+        const double r = (double)k / half_taps;
+        const double window = bessel_i0(beta * sqrt(1 - r * r)) / i0_beta;
+        const double x = 2 * cutoff / in_rate * k;
+        const double sinc = (x == 0) ? 1 : sin(M_PI * x) / (M_PI * x);
+        design.in[(k + nfft) % nfft] = (float)(2 * cutoff / in_rate * sinc * window);
+    }
+    rfft_execute(&design);
+    // The 1 / nfft undoes the gain of the forward and inverse transforms, with the real output
+    // keeping half the power of the one-sided band
+    for (int k = 0; k <= out_bins; ++k)
+        me->response[k] = design.out[k].r / nfft;
+    rfft_free(&design);
+    return true;
+}
+
+void ddc_channel_free(ddc_channel_t* me)
+{
+    free(me->response);
+    free(me->spectrum);
+    free(me->time);
+    kiss_fftr_free(me->inverse);
+    memset(me, 0, sizeof(*me));
+}
+
+int ddc_channel_output(ddc_channel_t* me, const ddc_t* ddc, float* out)
+{
+    const int nfft = ddc->nfft;
+    const int out_nfft = ddc->out_nfft;
+    const int out_bins = out_nfft / 4;
+    const kiss_fft_cpx* in = ddc->fft.out;
+    // Each block starts half a block after the last, which turns bin c by pi * c
+    const float sign = ((me->center_bin & (ddc->block - 1) & 1) != 0) ? -1.0f : 1.0f;
+
+    for (int k = -out_bins; k <= out_bins; ++k)
+    {
+        // Bins outside 0 .. nfft / 2 are mirror images (complex conjugates) of ones inside
+        int bin = me->center_bin + k;
+        float conj = 1.0f;
+        if (bin < 0)
+        {
+            bin = -bin;
+            conj = -1.0f;
+        }
+        else if (bin > nfft / 2)
+        {
+            bin = nfft - bin;
+            conj = -1.0f;
+        }
+        const float gain = sign * me->response[abs(k)];
+        me->spectrum[out_bins + k].r = gain * in[bin].r;
+        me->spectrum[out_bins + k].i = gain * conj * in[bin].i;
+    }
+    me->spectrum[0].i = me->spectrum[out_nfft / 2].i = 0;
+    kiss_fftri(me->inverse, me->spectrum, me->time);
+
+    // Only the middle half is free of circular wrap-around
+    const int count = out_nfft / 2;
+    memcpy(out, me->time + out_nfft / 4, count * sizeof(out[0]));
+    return count;
+}
@@ -0,0 +1,84 @@
+#ifndef _INCLUDE_DDC_H_
+#define _INCLUDE_DDC_H_
+
+#include <stdbool.h>
+
+#include "common/rfft.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DDC_BLOCK_TIME (0.16f)  ///< Span of a channel's inverse FFT (seconds); each block yields half of it
+#define DDC_TRANSITION (200.0f) ///< From a band edge to full rejection (Hz)
+#define DDC_STOPBAND_DB (80.0f) ///< Filter attenuation outside the band and its transition
+
+    /// Digital down-converter front end for wideband captures: a fast convolution filter bank.
+    /// The real input is cut into blocks of nfft samples that overlap by half (overlap-save) and each block
+    /// gets one forward FFT, shared by all the sub-bands (ddc_channel_t) taken from it. A channel weights
+    /// the bins of its band with its filter, moves them to out_rate / 4 and inverse transforms only those,
+    /// which also decimates by in_rate / out_rate. The output lines up with the input: output sample n is
+    /// input sample n * decim.
+    /// Used like stft_t: push samples until ready, compute, then collect each channel's output
+    typedef struct
+    {
+        int decim;      ///< Input samples per output sample
+        int nfft;       ///< Forward FFT size (decim * out_nfft)
+        int out_nfft;   ///< Channel inverse FFT size
+        float bin_hz;   ///< Bin spacing, the same at both rates (Hz)
+        float* buffer;  ///< Input block being collected (nfft samples)
+        int fill;       ///< Samples in the buffer
+        int block;      ///< Blocks computed since the last reset
+        rfft_t fft;     ///< Forward FFT; fft.out holds the spectrum of the last block computed
+    } ddc_t;
+
+    /// One sub-band of the input as a real signal at out_rate, centred on out_rate / 4.
+    /// An input frequency f comes out at f - shift
+    typedef struct
+    {
+        int center_bin;         ///< Input bin that becomes out_rate / 4
+        float shift;            ///< Input frequency minus output frequency (Hz)
+        float* response;        ///< Filter gain 0 .. out_nfft / 4 bins from the centre, FFT scaling included
+        kiss_fft_cpx* spectrum; ///< Output spectrum (out_nfft / 2 + 1 bins)
+        kiss_fft_scalar* time;  ///< Inverse FFT output (out_nfft samples)
+        kiss_fftr_cfg inverse;  ///< Kiss FFT inverse plan
+    } ddc_channel_t;
+
+    /// Set up for input at in_rate, a multiple of out_rate
+    /// @return false if the rates don't fit or memory runs out
+    bool ddc_init(ddc_t* me, int in_rate, int out_rate, rfft_backend_t backend);
+    void ddc_free(ddc_t* me);
+    /// Forget the input, for a new slot
+    void ddc_reset(ddc_t* me);
+
+    /// Add input samples until the block is complete
+    /// @return Number of samples consumed
+    int ddc_push(ddc_t* me, const float* samples, int n);
+
+    /// True when a block is complete and ddc_compute() is due
+    static inline bool ddc_ready(const ddc_t* me)
+    {
+        return me->fill == me->nfft;
+    }
+
+    /// Transform the complete block and keep its second half for the next one
+    void ddc_compute(ddc_t* me);
+
+    /// Set up a channel for the band low .. high Hz of the input. The filter passes the band and is
+    /// DDC_STOPBAND_DB down DDC_TRANSITION beyond each edge, so the band can be up to
+    /// out_rate / 2 - 2 * DDC_TRANSITION wide (5.6 kHz for 12 kHz output)
+    /// @return false if the band is too wide, runs past the input's Nyquist frequency, or memory runs out
+    bool ddc_channel_init(ddc_channel_t* me, const ddc_t* ddc, float low, float high);
+    void ddc_channel_free(ddc_channel_t* me);
+
+    /// Take the channel's share of the block just computed
+    /// @param[out] out Room for out_nfft / 2 samples
+    /// @return Number of samples written (out_nfft / 2)
+    int ddc_channel_output(ddc_channel_t* me, const ddc_t* ddc, float* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_DDC_H_
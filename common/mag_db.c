@@ -0,0 +1,179 @@
+// Waterfall magnitude conversion: complex FFT bins -> power in 0.5 dB steps as uint8
+// The vector versions replace log10f() with a short atanh series, which is all
+// the precision an 8-bit result needs
+
+#include "mag_db.h"
+
+#include <math.h>
+#include <string.h>
+
+#define MAG_DB_FLOOR (1E-12f)                     ///< Added to the power so log() never sees zero (-120 dB)
+#define MAG_DB_SCALE (8.6858896380650365f)        ///< 2 steps per dB: 2 * 10 * log10(x) = (20 / ln 10) * ln(x)
+#define MAG_DB_LN2   (0.69314718055994531f)
+#define MAG_DB_SQRT1_2_BITS (0x3f3504f3)          ///< Bit pattern of sqrt(1/2) as a float
+
+static inline uint8_t quantize_db(float mag2)
+{
+    float db = 10.0f * log10f(MAG_DB_FLOOR + mag2);
+    // Scale decibels to unsigned 8-bit range and clamp the value
+    // Range 0-240 covers -120..0 dB in 0.5 dB steps
+    int scaled = (int)(2 * db + 240);
+    return (scaled < 0) ? 0 : ((scaled > 255) ? 255 : scaled);
+}
+
+float mag_db_scalar(const kiss_fft_cpx* bins, int n, uint8_t* out)
+{
+    float max_mag2 = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        float mag2 = (bins[i].i * bins[i].i) + (bins[i].r * bins[i].r);
+        out[i] = quantize_db(mag2);
+        if (mag2 > max_mag2)
+            max_mag2 = mag2;
+    }
+    return max_mag2;
+}
+
+// Both vector versions compute ln(x) the same way:
+// x = 2^e * m with m in [sqrt(1/2), sqrt(2)), found by subtracting the bit pattern of sqrt(1/2)
+// ln(m) = 2 * atanh(t) with t = (m - 1) / (m + 1), |t| < 0.172, so five terms of the series suffice
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_MAG_DB_AVX2 1
+#include <immintrin.h>
+
+__attribute__((target("avx2"))) static inline __m256 ln_avx2(__m256 x)
+{
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i e = _mm256_srai_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(MAG_DB_SQRT1_2_BITS)), 23);
+    __m256 m = _mm256_castsi256_ps(_mm256_sub_epi32(bits, _mm256_slli_epi32(e, 23)));
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(1.0f / 9);
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.0f / 7));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.0f / 5));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.0f / 3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), one);
+    __m256 ln_m = _mm256_mul_ps(_mm256_add_ps(t, t), p);
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(e), _mm256_set1_ps(MAG_DB_LN2)), ln_m);
+}
+
+__attribute__((target("avx2"))) static float mag_db_avx2(const kiss_fft_cpx* bins, int n, uint8_t* out)
+{
+    const float* p = (const float*)bins;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_step = _mm256_set1_epi32(255);
+    __m256 vmax = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 a = _mm256_loadu_ps(p + 2 * i); // Bins i..i+3 as r,i pairs
+        __m256 b = _mm256_loadu_ps(p + 2 * i + 8); // Bins i+4..i+7
+        a = _mm256_mul_ps(a, a);
+        b = _mm256_mul_ps(b, b);
+        // hadd leaves the bins in order i, i+1, i+4, i+5, i+2, i+3, i+6, i+7; swap the middle pairs back
+        __m256 mag2 = _mm256_hadd_ps(a, b);
+        mag2 = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(mag2), 0xD8));
+        vmax = _mm256_max_ps(vmax, mag2);
+
+        __m256 x = _mm256_add_ps(mag2, _mm256_set1_ps(MAG_DB_FLOOR));
+        __m256 scaled = _mm256_add_ps(_mm256_mul_ps(ln_avx2(x), _mm256_set1_ps(MAG_DB_SCALE)), _mm256_set1_ps(240.0f));
+        __m256i q = _mm256_cvttps_epi32(scaled); // Truncate like the (int) cast in quantize_db()
+        q = _mm256_min_epi32(_mm256_max_epi32(q, zero), max_step);
+
+        // Narrow within each 128-bit lane, then pick the low 4 bytes of each lane
+        __m256i q8 = _mm256_packus_epi16(_mm256_packs_epi32(q, q), zero);
+        uint32_t lo = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(q8));
+        uint32_t hi = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(q8, 1));
+        memcpy(out + i, &lo, sizeof lo);
+        memcpy(out + i + 4, &hi, sizeof hi);
+    }
+    __m128 m4 = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+    m4 = _mm_max_ps(m4, _mm_movehl_ps(m4, m4));
+    m4 = _mm_max_ss(m4, _mm_shuffle_ps(m4, m4, 1));
+    float max_mag2 = _mm_cvtss_f32(m4);
+
+    float tail_max = mag_db_scalar(bins + i, n - i, out + i);
+    return (tail_max > max_mag2) ? tail_max : max_mag2;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_MAG_DB_NEON 1
+#include <arm_neon.h>
+
+static inline float32x4_t ln_neon(float32x4_t x)
+{
+    int32x4_t bits = vreinterpretq_s32_f32(x);
+    int32x4_t e = vshrq_n_s32(vsubq_s32(bits, vdupq_n_s32(MAG_DB_SQRT1_2_BITS)), 23);
+    float32x4_t m = vreinterpretq_f32_s32(vsubq_s32(bits, vshlq_n_s32(e, 23)));
+
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t t = vdivq_f32(vsubq_f32(m, one), vaddq_f32(m, one));
+    float32x4_t t2 = vmulq_f32(t, t);
+    float32x4_t p = vdupq_n_f32(1.0f / 9);
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(1.0f / 7));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(1.0f / 5));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(1.0f / 3));
+    p = vaddq_f32(vmulq_f32(p, t2), one);
+    float32x4_t ln_m = vmulq_f32(vaddq_f32(t, t), p);
+    return vaddq_f32(vmulq_f32(vcvtq_f32_s32(e), vdupq_n_f32(MAG_DB_LN2)), ln_m);
+}
+
+static inline int32x4_t quantize_neon(float32x4_t mag2)
+{
+    float32x4_t x = vaddq_f32(mag2, vdupq_n_f32(MAG_DB_FLOOR));
+    float32x4_t scaled = vaddq_f32(vmulq_f32(ln_neon(x), vdupq_n_f32(MAG_DB_SCALE)), vdupq_n_f32(240.0f));
+    return vcvtq_s32_f32(scaled); // Truncates toward zero
+}
+
+static float mag_db_neon(const kiss_fft_cpx* bins, int n, uint8_t* out)
+{
+    const float* p = (const float*)bins;
+    float32x4_t vmax = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        float32x4x2_t a = vld2q_f32(p + 2 * i); // De-interleaved: val[0] = r, val[1] = i
+        float32x4x2_t b = vld2q_f32(p + 2 * i + 8);
+        float32x4_t m0 = vaddq_f32(vmulq_f32(a.val[1], a.val[1]), vmulq_f32(a.val[0], a.val[0]));
+        float32x4_t m1 = vaddq_f32(vmulq_f32(b.val[1], b.val[1]), vmulq_f32(b.val[0], b.val[0]));
+        vmax = vmaxq_f32(vmax, vmaxq_f32(m0, m1));
+
+        // Saturating narrows do the clamp to 0..255
+        uint16x8_t q16 = vcombine_u16(vqmovun_s32(quantize_neon(m0)), vqmovun_s32(quantize_neon(m1)));
+        vst1_u8(out + i, vqmovn_u16(q16));
+    }
+    float max_mag2 = vmaxvq_f32(vmax);
+
+    float tail_max = mag_db_scalar(bins + i, n - i, out + i);
+    return (tail_max > max_mag2) ? tail_max : max_mag2;
+}
+#endif
+
+mag_db_fn mag_db_select(void)
+{
+#if defined(HAVE_MAG_DB_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        return mag_db_avx2;
+#endif
+#if defined(HAVE_MAG_DB_NEON)
+    return mag_db_neon;
+#endif
+    return mag_db_scalar;
+}
+
+const char* mag_db_name(mag_db_fn fn)
+{
+#if defined(HAVE_MAG_DB_AVX2)
+    if (fn == mag_db_avx2)
+        return "avx2";
+#endif
+#if defined(HAVE_MAG_DB_NEON)
+    if (fn == mag_db_neon)
+        return "neon";
+#endif
+    return "scalar";
+}
@@ -0,0 +1,36 @@
+#ifndef _INCLUDE_MAG_DB_H_
+#define _INCLUDE_MAG_DB_H_
+
+#include <stdint.h>
+
+#include "fft/kiss_fft.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Convert FFT bins to waterfall magnitudes.
+    /// Each output byte is the bin power in 0.5 dB steps, 0 = -120 dB, clamped to 0..255.
+    /// @param[in] bins Complex FFT output
+    /// @param[in] n Number of bins to convert
+    /// @param[out] out n waterfall magnitudes
+    /// @return Largest bin power (linear, |bin|^2) seen
+    typedef float (*mag_db_fn)(const kiss_fft_cpx* bins, int n, uint8_t* out);
+
+    /// Exact reference version using log10f()
+    float mag_db_scalar(const kiss_fft_cpx* bins, int n, uint8_t* out);
+
+    /// Pick the fastest version the CPU supports (AVX2, NEON or scalar).
+    /// The vector versions use a polynomial log and may differ from mag_db_scalar() by one step
+    /// when the exact value falls very close to a step boundary
+    mag_db_fn mag_db_select(void);
+
+    /// Name of a kernel returned by mag_db_select(), for verbose output
+    const char* mag_db_name(mag_db_fn fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_MAG_DB_H_
@@ -0,0 +1,168 @@
+// Real FFT front end with a selectable implementation
+// Kiss FFT is always available; FFTW3 is used when built with FFTW=1
+
+#include "rfft.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_FFTW3F
+#include <fftw3.h>
+#include <pthread.h>
+
+// The FFTW planner isn't thread safe, but executing plans is
+static pthread_mutex_t Fftw_planner_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#ifdef HAVE_FFTW3F
+rfft_backend_t Rfft_default_backend = RFFT_FFTW;
+#else
+rfft_backend_t Rfft_default_backend = RFFT_KISS;
+#endif
+
+static const char* const kBackend_names[RFFT_NUM_BACKENDS] = { "kiss", "fftw" };
+
+bool rfft_available(rfft_backend_t backend)
+{
+    switch (backend)
+    {
+    case RFFT_KISS:
+        return true;
+#ifdef HAVE_FFTW3F
+    case RFFT_FFTW:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* rfft_backend_name(rfft_backend_t backend)
+{
+    return (backend >= 0 && backend < RFFT_NUM_BACKENDS) ? kBackend_names[backend] : "unknown";
+}
+
+bool rfft_parse_backend(const char* name, rfft_backend_t* backend)
+{
+    for (int i = 0; i < RFFT_NUM_BACKENDS; ++i)
+    {
+        if (strcmp(name, kBackend_names[i]) == 0 && rfft_available((rfft_backend_t)i))
+        {
+            *backend = (rfft_backend_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool rfft_init(rfft_t* me, int nfft, rfft_backend_t backend)
+{
+    memset(me, 0, sizeof(*me));
+    if (backend == RFFT_NUM_BACKENDS)
+        backend = Rfft_default_backend;
+    if (!rfft_available(backend))
+        backend = RFFT_KISS;
+    me->backend = backend;
+    me->nfft = nfft;
+
+#ifdef HAVE_FFTW3F
+    if (backend == RFFT_FFTW)
+    {
+        // fftwf_malloc gives the alignment the SIMD codelets want; fftwf_complex has the same layout as kiss_fft_cpx
+        me->in = (kiss_fft_scalar*)fftwf_malloc(nfft * sizeof(me->in[0]));
+        me->out = (kiss_fft_cpx*)fftwf_malloc((nfft / 2 + 1) * sizeof(me->out[0]));
+        if (me->in == NULL || me->out == NULL)
+        {
+            rfft_free(me);
+            return false;
+        }
+        pthread_mutex_lock(&Fftw_planner_lock);
+        me->fftw_plan = fftwf_plan_dft_r2c_1d(nfft, me->in, (fftwf_complex*)me->out, FFTW_MEASURE);
+        pthread_mutex_unlock(&Fftw_planner_lock);
+        if (me->fftw_plan == NULL)
+        {
+            rfft_free(me);
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    me->in = (kiss_fft_scalar*)malloc(nfft * sizeof(me->in[0]));
+    me->out = (kiss_fft_cpx*)malloc((nfft / 2 + 1) * sizeof(me->out[0]));
+    size_t kiss_work_size = 0;
+    kiss_fftr_alloc(nfft, 0, 0, &kiss_work_size);
+    me->kiss_work = malloc(kiss_work_size);
+    if (me->in == NULL || me->out == NULL || me->kiss_work == NULL)
+    {
+        rfft_free(me);
+        return false;
+    }
+    me->kiss_cfg = kiss_fftr_alloc(nfft, 0, me->kiss_work, &kiss_work_size);
+    return true;
+}
+
+void rfft_free(rfft_t* me)
+{
+#ifdef HAVE_FFTW3F
+    if (me->backend == RFFT_FFTW)
+    {
+        pthread_mutex_lock(&Fftw_planner_lock);
+        if (me->fftw_plan != NULL)
+            fftwf_destroy_plan((fftwf_plan)me->fftw_plan);
+        pthread_mutex_unlock(&Fftw_planner_lock);
+        fftwf_free(me->in);
+        fftwf_free(me->out);
+        memset(me, 0, sizeof(*me));
+        return;
+    }
+#endif
+    free(me->kiss_work);
+    free(me->out);
+    free(me->in);
+    memset(me, 0, sizeof(*me));
+}
+
+void rfft_execute(rfft_t* me)
+{
+#ifdef HAVE_FFTW3F
+    if (me->backend == RFFT_FFTW)
+    {
+        fftwf_execute((fftwf_plan)me->fftw_plan);
+        return;
+    }
+#endif
+    kiss_fftr(me->kiss_cfg, me->in, me->out);
+}
+
+int rfft_factorize(int nfft, char* text, size_t text_size)
+{
+    int n = nfft / 2;
+    int largest = 1;
+    int len = 0;
+    if (text != NULL && text_size > 0)
+        len = snprintf(text, text_size, "%d =", n);
+
+    for (int p = 2; n > 1; ++p)
+    {
+        int power = 0;
+        while (n % p == 0)
+        {
+            n /= p;
+            ++power;
+        }
+        if (power == 0)
+            continue;
+        largest = p;
+        if (text != NULL && len >= 0 && (size_t)len < text_size)
+        {
+            const char* sep = (len > 0 && text[len - 1] == '=') ? " " : " * ";
+            if (power > 1)
+                len += snprintf(text + len, text_size - len, "%s%d^%d", sep, p, power);
+            else
+                len += snprintf(text + len, text_size - len, "%s%d", sep, p);
+        }
+    }
+    return largest;
+}
@@ -0,0 +1,69 @@
+#ifndef _INCLUDE_RFFT_H_
+#define _INCLUDE_RFFT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fft/kiss_fftr.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Real FFT implementations
+    typedef enum
+    {
+        RFFT_KISS, ///< Kiss FFT, always available
+        RFFT_FFTW, ///< FFTW3 single precision (only when built with FFTW=1)
+        RFFT_NUM_BACKENDS
+    } rfft_backend_t;
+
+    /// Forward real FFT of a fixed size. Fill in[] with nfft samples, call rfft_execute(),
+    /// and read nfft / 2 + 1 bins from out[]. Both buffers are owned by the plan.
+    typedef struct
+    {
+        rfft_backend_t backend;
+        int nfft;
+        kiss_fft_scalar* in; ///< Input samples (nfft)
+        kiss_fft_cpx* out;   ///< Output bins (nfft / 2 + 1)
+
+        void* kiss_work;        ///< Kiss FFT work area
+        kiss_fftr_cfg kiss_cfg; ///< Kiss FFT housekeeping object
+        void* fftw_plan;        ///< fftwf_plan when backend is RFFT_FFTW
+    } rfft_t;
+
+    /// Backend used when rfft_init() is asked for RFFT_NUM_BACKENDS (the default)
+    extern rfft_backend_t Rfft_default_backend;
+
+    /// Create a plan. Falls back to Kiss FFT if the requested backend isn't compiled in.
+    /// @param[in] backend Implementation to use, or RFFT_NUM_BACKENDS for Rfft_default_backend
+    /// @return false if memory could not be allocated
+    bool rfft_init(rfft_t* me, int nfft, rfft_backend_t backend);
+
+    void rfft_free(rfft_t* me);
+
+    /// Transform in[] into out[]
+    void rfft_execute(rfft_t* me);
+
+    /// True if the backend was compiled in
+    bool rfft_available(rfft_backend_t backend);
+
+    const char* rfft_backend_name(rfft_backend_t backend);
+
+    /// Look up a backend by name ("kiss", "fftw")
+    /// @return false if the name is unknown or the backend isn't compiled in
+    bool rfft_parse_backend(const char* name, rfft_backend_t* backend);
+
+    /// Describe how well nfft suits the FFT implementations.
+    /// Kiss FFT computes a real FFT as a complex FFT of nfft / 2 points and has fast butterflies only
+    /// for radix 2, 3, 4 and 5; any larger prime factor falls back to an O(p^2) generic butterfly.
+    /// @param[out] text Factorization of nfft / 2, e.g. "1920 = 2^7 * 3 * 5" (may be NULL)
+    /// @return Largest prime factor of nfft / 2; anything above 5 is an awkward size
+    int rfft_factorize(int nfft, char* text, size_t text_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_RFFT_H_
@@ -0,0 +1,118 @@
+// Streaming STFT front end shared by the file and live decoders
+
+#include "stft.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool stft_init(stft_t* me, int nfft, int hop, stft_window_fn window, float norm, rfft_backend_t backend)
+{
+    memset(me, 0, sizeof(*me));
+    me->nfft = nfft;
+    me->hop = hop;
+
+    me->window = (float*)malloc(nfft * sizeof(me->window[0]));
+    me->window_s16 = (float*)malloc(nfft * sizeof(me->window_s16[0]));
+    me->ring = (float*)malloc(2 * nfft * sizeof(me->ring[0]));
+    bool fft_ok = rfft_init(&me->fft, nfft, backend);
+
+    if (me->window == NULL || me->window_s16 == NULL || me->ring == NULL || !fft_ok)
+    {
+        stft_free(me);
+        return false;
+    }
+
+    for (int i = 0; i < nfft; ++i)
+    {
+        me->window[i] = norm * window(i, nfft);
+        // A power of 2, so windowing raw 16-bit samples gives exactly what scaling them first would
+        me->window_s16[i] = me->window[i] * (1.0f / 32768);
+    }
+    stft_reset(me);
+    return true;
+}
+
+void stft_free(stft_t* me)
+{
+    rfft_free(&me->fft);
+    free(me->ring);
+    free(me->window);
+    free(me->window_s16);
+    memset(me, 0, sizeof(*me));
+}
+
+void stft_reset(stft_t* me)
+{
+    memset(me->ring, 0, 2 * me->nfft * sizeof(me->ring[0]));
+    me->pos = 0;
+    me->fill = 0;
+    me->s16 = false;
+}
+
+int stft_push(stft_t* me, const float* samples, int n)
+{
+    me->s16 = false;
+    int count = me->hop - me->fill;
+    if (count > n)
+        count = n;
+
+    // Write each sample into both halves of the ring, so ring[pos..pos+nfft-1] is always the current frame
+    float* lo = me->ring;
+    float* hi = me->ring + me->nfft;
+    int pos = me->pos;
+    for (int i = 0; i < count; ++i)
+    {
+        lo[pos] = hi[pos] = samples[i];
+        if (++pos == me->nfft)
+            pos = 0;
+    }
+    me->pos = pos;
+    me->fill += count;
+    return count;
+}
+
+int stft_push_s16(stft_t* me, const int16_t* samples, int n)
+{
+    me->s16 = true;
+    int count = me->hop - me->fill;
+    if (count > n)
+        count = n;
+
+    // As stft_push(), storing the samples unscaled; the scale is in window_s16
+    float* lo = me->ring;
+    float* hi = me->ring + me->nfft;
+    int pos = me->pos;
+    for (int i = 0; i < count; ++i)
+    {
+        lo[pos] = hi[pos] = samples[i];
+        if (++pos == me->nfft)
+            pos = 0;
+    }
+    me->pos = pos;
+    me->fill += count;
+    return count;
+}
+
+// Windowing is done while packing the FFT input
+static const kiss_fft_cpx* transform(stft_t* me, const float* frame, const float* window)
+{
+    kiss_fft_scalar* timedata = me->fft.in;
+    for (int i = 0; i < me->nfft; ++i)
+    {
+        timedata[i] = window[i] * frame[i];
+    }
+    rfft_execute(&me->fft);
+    return me->fft.out;
+}
+
+const kiss_fft_cpx* stft_compute(stft_t* me)
+{
+    const kiss_fft_cpx* freqdata = transform(me, me->ring + me->pos, me->s16 ? me->window_s16 : me->window);
+    me->fill = 0;
+    return freqdata;
+}
+
+const kiss_fft_cpx* stft_compute_frame(stft_t* me, const float* frame)
+{
+    return transform(me, frame, me->window);
+}
@@ -0,0 +1,77 @@
+#ifndef _INCLUDE_STFT_H_
+#define _INCLUDE_STFT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rfft.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Window function: value of sample i of an N-point window
+    typedef float (*stft_window_fn)(int i, int N);
+
+    /// Streaming short-time Fourier transform.
+    /// Samples may be pushed in chunks of any size; a new analysis frame is ready every 'hop' samples.
+    /// The input history lives in a mirrored ring buffer (every sample is stored twice, nfft apart),
+    /// so the current frame is always contiguous and nothing is shifted between frames.
+    typedef struct
+    {
+        int nfft;                  ///< FFT size (analysis frame length)
+        int hop;                   ///< Number of new samples between frames
+        float* window;             ///< Window with the FFT normalization folded in (nfft samples)
+        float* window_s16;         ///< The same with the 1/32768 scale of 16-bit samples folded in as well
+        bool s16;                  ///< The history holds raw 16-bit sample values (the last push was stft_push_s16())
+        float* ring;               ///< Input history (2 * nfft samples)
+        int pos;                   ///< Ring position of the oldest sample in the current frame
+        int fill;                  ///< Samples pushed since the last frame was computed
+        rfft_t fft;                ///< FFT plan; its input buffer receives the windowed frame
+    } stft_t;
+
+    /// Set up a transform. The history starts out as silence.
+    /// @param[in] nfft FFT size (must be even)
+    /// @param[in] hop Number of samples between analysis frames (1..nfft)
+    /// @param[in] window Window function
+    /// @param[in] norm Scale factor applied to every sample along with the window
+    /// @param[in] backend FFT implementation (RFFT_NUM_BACKENDS for the default)
+    /// @return false if memory could not be allocated
+    bool stft_init(stft_t* me, int nfft, int hop, stft_window_fn window, float norm, rfft_backend_t backend);
+
+    void stft_free(stft_t* me);
+
+    /// Clear the history to silence and restart the hop count
+    void stft_reset(stft_t* me);
+
+    /// Push samples, stopping early if a frame becomes ready
+    /// @return Number of samples consumed; call stft_compute() when stft_ready() and push the rest
+    int stft_push(stft_t* me, const float* samples, int n);
+
+    /// Push 16-bit samples as they are, without converting them to -1 .. +1 first
+    /// (the scale is applied along with the window). Use one format or the other within a stream:
+    /// a frame is windowed according to the last push
+    /// @return Number of samples consumed
+    int stft_push_s16(stft_t* me, const int16_t* samples, int n);
+
+    /// True when a full hop of new samples has been pushed since the last frame
+    static inline bool stft_ready(const stft_t* me)
+    {
+        return me->fill >= me->hop;
+    }
+
+    /// Window and transform the newest nfft samples
+    /// @return Spectrum (nfft / 2 + 1 bins), valid until the next call
+    const kiss_fft_cpx* stft_compute(stft_t* me);
+
+    /// Window and transform an arbitrary frame of nfft samples, leaving the history alone
+    /// (used to recompute old frames after the signal has been changed)
+    /// @return Spectrum (nfft / 2 + 1 bins), valid until the next call
+    const kiss_fft_cpx* stft_compute_frame(stft_t* me, const float* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_STFT_H_
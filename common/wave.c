@@ -6,10 +6,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdint.h>
-#ifdef __linux
-#include <bsd/stdlib.h>
-#endif
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 // Save signal in floating point format (-1 .. +1) as a WAVE file using 16-bit signed integers.
@@ -74,158 +73,253 @@ void save_wav(const float* signal, int num_samples, int sample_rate, const char*
 
 // Load signal in floating point format (-1 .. +1) as a WAVE file using 16-bit signed integers.
 // Rewritten 4 May 2025 KA9Q to be more tolerant of variant headers
+// Now reads through wav_open(), so the buffer is exactly as long as the data
 // Expects to be called with the file already open for reading on fd. path used only for error messages
 int load_wav(float **signal, int* num_frames, int *num_channels, int* sample_rate, const char* path,int fd){
   if(signal == NULL || num_frames == NULL || num_channels == NULL || sample_rate == NULL || path == NULL)
     return -1;
 
-  FILE *f = fdopen(fd, "rb");
-  if(f == NULL){
-    fprintf(stderr,"fdopen(%s) failed: %s\n",path,strerror(errno));
+  wav_reader_t wav;
+  if(wav_open(&wav, fd, path) != 0)
+    return -1;
+  *num_channels = wav.num_channels;
+  *sample_rate = wav.sample_rate;
+  if(*signal == NULL) // What if it's not null? We don't know what it is, should it be freed?
+    *signal = malloc(sizeof(float) * (wav.num_frames > 0 ? wav.num_frames : 1));
+  if(*signal == NULL){
+    wav_close(&wav);
     return -1;
   }
-  // NOTE: works only on little-endian architecture
-  char chunkID[4]; // = {'R', 'I', 'F', 'F'};
-  if(fread((void*)chunkID, sizeof(chunkID), 1, f) != 1)
-    goto quit;
-  uint32_t chunkSize; // = 4 + (8 + subChunk1Size) + (8 + subChunk2Size);
-  if(fread((void*)&chunkSize, sizeof(chunkSize), 1, f) != 1)
-    goto quit;
-  char format[4]; // = {'W', 'A', 'V', 'E'};
-  if(fread((void*)format, sizeof(format), 1, f) != 1)
-    goto quit;
-  if(feof(f)){
+  *num_frames = wav_read(&wav, *signal, wav.num_frames);
+  wav_close(&wav);
+  return 0;
+}
+
+// Map the file and walk its chunks in place; same tolerance of variant headers as load_wav() always had
+int wav_open(wav_reader_t *me, int fd, const char *path){
+  if(me == NULL || path == NULL)
+    return -1;
+  memset(me, 0, sizeof *me);
+  struct stat statbuf;
+  if(fstat(fd, &statbuf) != 0){
+    fprintf(stderr,"fstat(%s) failed: %s\n",path,strerror(errno));
+    return -1;
+  }
+  if(statbuf.st_size < 12){
     fprintf(stderr,"%s: premature EOF 1\n",path);
-    goto quit;
+    return -1;
   }
-  if(strncmp(chunkID,"RIFF",4) != 0){
+  void *map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED){
+    fprintf(stderr,"mmap(%s) failed: %s\n",path,strerror(errno));
+    return -1;
+  }
+  madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+  me->map = map;
+  me->map_size = statbuf.st_size;
+
+  // NOTE: works only on little-endian architecture
+  uint8_t const *p = me->map;
+  uint8_t const * const end = p + me->map_size;
+  if(memcmp(p,"RIFF",4) != 0){
     fprintf(stderr,"%s: not RIFF\n",path);
     goto quit;
   }
-
-  if(strncmp(format,"WAVE",4) !=0 ){
+  if(memcmp(p + 8,"WAVE",4) != 0){
     fprintf(stderr,"%s: not WAVE\n",path);
     goto quit;
   }
+  p += 12;
   uint16_t audioFormat = 0; // = 1;     // PCM = 1
   uint16_t numChannels = 0; // = 1;
   uint16_t bitsPerSample = 0; // = 16;
   uint32_t sampleRate = 0;
   uint16_t blockAlign = 0; // = numChannels * bitsPerSample / 8;
-  uint32_t byteRate = 0; // = sampleRate * blockAlign;
-
-  while(!feof(f)){
-    // Will normally hit EOF when trying to read the next chunk ID after data
-    if(fread((void*)chunkID, sizeof(chunkID), 1, f) != 1)
-      break;
-    if(fread((void*)&chunkSize, sizeof(chunkSize), 1, f) != 1)
-      break;
-    if(feof(f))
-      break;
-    if(strncmp(chunkID,"fmt ",4) == 0){
-      if(chunkSize < 16){
-	fprintf(stderr,"%s: chunkSize %d too small\n",path,chunkSize);
+  bool have_fmt = false;
+  while(end - p >= 8){
+    uint32_t chunkSize;
+    memcpy(&chunkSize, p + 4, sizeof chunkSize);
+    uint8_t const * const body = p + 8;
+    if(memcmp(p,"fmt ",4) == 0){
+      if(chunkSize < 16 || end - body < 16){
+	fprintf(stderr,"%s: chunkSize %u too small\n",path,chunkSize);
 	goto quit;
       }
-      // Standard part of header
-      if(fread((void*)&audioFormat, sizeof(audioFormat), 1, f) != 1)
-	goto quit;
-      if(fread((void*)&numChannels, sizeof(numChannels), 1, f) != 1)
-	goto quit;
-      *num_channels = numChannels;
-      if(fread((void*)&sampleRate, sizeof(sampleRate), 1, f) != 1)
-	goto quit;
-      if(fread((void*)&byteRate, sizeof(byteRate), 1, f) != 1)
-	goto quit;
-      if(fread((void*)&blockAlign, sizeof(blockAlign), 1, f) != 1)
-	goto quit;
-      if(fread((void*)&bitsPerSample, sizeof(bitsPerSample), 1, f) != 1)
-	goto quit;
-      if(feof(f)){
-	fprintf(stderr,"%s: premature EOF 3\n",path);
-	goto quit;
-      }
-      if(chunkSize > 16){
-	// Skip the rest of the longer fmt header
-	fseek(f,chunkSize-16,SEEK_CUR); // Skip unsupported chunk
-      }
+      memcpy(&audioFormat, body, sizeof audioFormat);
+      memcpy(&numChannels, body + 2, sizeof numChannels);
+      memcpy(&sampleRate, body + 4, sizeof sampleRate);
+      memcpy(&blockAlign, body + 12, sizeof blockAlign);
+      memcpy(&bitsPerSample, body + 14, sizeof bitsPerSample);
       if (numChannels != 1){
 	fprintf(stderr,"%s: numChannels %d, must be 1\n", path,numChannels);
 	goto quit;
       }
-    } else if(strncmp(chunkID,"data",4) == 0){
-      // Process data
-      if(chunkSize != 0xffffffff) // typical placeholder for "indeterminate"
-	*num_frames = chunkSize / blockAlign;
-      else
-	*num_frames = 10000000; // wing it: 10 million = 15 sec * 667 kHz
-
-      *sample_rate = sampleRate;
-      if(*signal == NULL){ // What if it's not null? We don't know what it is, should it be freed?
-	size_t nbytes = sizeof(float) * numChannels * *num_frames;
-	*signal = malloc(nbytes);
+      have_fmt = true;
+    } else if(memcmp(p,"data",4) == 0){
+      if(!have_fmt){
+	fprintf(stderr,"%s: data chunk before fmt chunk\n",path);
+	goto quit;
       }
       switch(audioFormat){
       case 1: // 16-bit signed int
-	{
-	  if(bitsPerSample != 16){
-	    fprintf(stderr,"%s: bits per sample %d for PCM; must be 16\n",path,bitsPerSample);
-	    goto quit;
-	  }
-	  int count;
-	  for(count = 0; count < *num_frames * numChannels; count++){ // numChannels must be 1
-	    int16_t s;
-	    if(fread(&s,sizeof s, 1, f) != 1)
-	      break;
-
-	    (*signal)[count] = s / 32768.0f; // compiler should optimize
-	  }
-	  if(count != *num_frames * numChannels){
-	    // Trim buffer and return the actual count
-	    *signal = reallocf(*signal,sizeof(float) * count);
-	    *num_frames = count / numChannels;
-	  }
+	if(bitsPerSample != 16 || blockAlign != sizeof(int16_t)){
+	  fprintf(stderr,"%s: bits per sample %d for PCM; must be 16\n",path,bitsPerSample);
+	  goto quit;
 	}
 	break;
       case 3: // 32-bit float
-	{
-	  if(bitsPerSample != 32){
-	    fprintf(stderr,"%s: bits per sample %d for float; must be 32\n",path,bitsPerSample);
-	    goto quit;
-	  }
-	  if(blockAlign != numChannels * sizeof(float)){
-	    fprintf(stderr,"%s: unexpected blockAlign %u for float WAV file\n",path,blockAlign);
-	    goto quit;
-	  }
-	  int const count = fread(*signal,blockAlign,*num_frames, f); // Read floating point directly
-	  if(count != *num_frames){
-	    // Trim buffer and return the actual count
-	    *signal = reallocf(*signal,blockAlign * count);
-	    *num_frames = count;
-	  }
+	if(bitsPerSample != 32){
+	  fprintf(stderr,"%s: bits per sample %d for float; must be 32\n",path,bitsPerSample);
+	  goto quit;
+	}
+	if(blockAlign != sizeof(float)){
+	  fprintf(stderr,"%s: unexpected blockAlign %u for float WAV file\n",path,blockAlign);
+	  goto quit;
 	}
 	break;
       default:
 	fprintf(stderr,"%s: unsupported audio format %d\n",path,audioFormat);
 	goto quit;
       }
-      // If we haven't read all the data in the file, skip over the rest of the chunk
-      // There will probably not be another chunk, but this will force the eof when we loop back to
-      // read another chunk
-      if(chunkSize / blockAlign > *num_frames){
-	long extra = chunkSize - *num_frames * blockAlign;
-	fseek(f,extra,SEEK_CUR);
-      }
-    } else {
-      fseek(f,chunkSize,SEEK_CUR); // Skip unsupported subchunk
+      // 0xffffffff is the typical placeholder for "indeterminate"; either way take no more than the file has
+      size_t data_size = chunkSize;
+      if(data_size > (size_t)(end - body))
+	data_size = end - body;
+      me->data = body;
+      me->num_frames = data_size / blockAlign;
+      me->sample_rate = sampleRate;
+      me->num_channels = numChannels;
+      me->audio_format = audioFormat;
+      me->aligned = ((uintptr_t)body % (audioFormat == 1 ? _Alignof(int16_t) : _Alignof(float))) == 0;
+      return 0;
     }
+    if(chunkSize > (size_t)(end - body))
+      break;
+    p = body + chunkSize; // Skip unsupported subchunk
   }
-  fclose(f);
-  return 0;
+  fprintf(stderr,"%s: no data chunk\n",path);
  quit:
-  // If this was because of a .wav read failure, we could fall back to the external file attributes and try to read it as a raw file
-  // To be added?
-  if(f != NULL)
-    fclose(f);
+  wav_close(me);
   return -1;
 }
+
+int wav_read(wav_reader_t *me, float *out, int n){
+  if(n > me->num_frames - me->pos)
+    n = me->num_frames - me->pos;
+  if(n <= 0)
+    return 0;
+  if(me->audio_format == 1)
+    wav_s16_to_float(me->data + me->pos * sizeof(int16_t), out, n);
+  else
+    memcpy(out, me->data + me->pos * sizeof(float), n * sizeof(float)); // Floating point directly
+  me->pos += n;
+  return n;
+}
+
+int wav_next(wav_reader_t *me, int n, const void **samples){
+  if(n > me->num_frames - me->pos)
+    n = me->num_frames - me->pos;
+  if(n <= 0)
+    return 0;
+  *samples = me->data + me->pos * (me->audio_format == 1 ? sizeof(int16_t) : sizeof(float));
+  me->pos += n;
+  return n;
+}
+
+void wav_close(wav_reader_t *me){
+  if(me->map != NULL)
+    munmap((void *)me->map, me->map_size);
+  memset(me, 0, sizeof *me);
+}
+
+// Copy the samples to an aligned block first (they needn't be aligned in the file),
+// then convert; both loops vectorize
+void wav_s16_to_float(const void *in, float *out, int n){
+  uint8_t const *src = in;
+  int16_t block[512];
+  int const block_len = sizeof block / sizeof block[0];
+  for(int i = 0; i < n; i += block_len){
+    int const count = n - i < block_len ? n - i : block_len;
+    memcpy(block, src + i * sizeof(int16_t), count * sizeof(int16_t));
+    for(int k = 0; k < count; k++)
+      out[i + k] = block[k] * (1.0f / 32768); // Same as dividing by 32768: it's a power of 2
+  }
+}
+
+// Skip over bytes without seeking, so it works on pipes
+static int skip_bytes(FILE *f, uint32_t count){
+  char junk[512];
+  while(count > 0){
+    size_t chunk = count < sizeof junk ? count : sizeof junk;
+    if(fread(junk, 1, chunk, f) != chunk)
+      return -1;
+    count -= chunk;
+  }
+  return 0;
+}
+
+// Parse the RIFF header and chunks up to the start of the data chunk
+// Same tolerance of variant headers as load_wav(), but reads only forward
+int read_wav_header(FILE *f, const char *path, int *sample_rate, int *num_channels, int *audio_format, int *bits_per_sample, uint32_t *data_size){
+  if(f == NULL || path == NULL || sample_rate == NULL || num_channels == NULL || audio_format == NULL || bits_per_sample == NULL || data_size == NULL)
+    return -1;
+
+  // NOTE: works only on little-endian architecture
+  char chunkID[4];
+  uint32_t chunkSize;
+  char format[4];
+  if(fread(chunkID, sizeof(chunkID), 1, f) != 1
+     || fread(&chunkSize, sizeof(chunkSize), 1, f) != 1
+     || fread(format, sizeof(format), 1, f) != 1){
+    fprintf(stderr,"%s: premature EOF in header\n",path);
+    return -1;
+  }
+  if(strncmp(chunkID,"RIFF",4) != 0){
+    fprintf(stderr,"%s: not RIFF\n",path);
+    return -1;
+  }
+  if(strncmp(format,"WAVE",4) !=0 ){
+    fprintf(stderr,"%s: not WAVE\n",path);
+    return -1;
+  }
+  bool have_fmt = false;
+  while(true){
+    if(fread(chunkID, sizeof(chunkID), 1, f) != 1 || fread(&chunkSize, sizeof(chunkSize), 1, f) != 1){
+      fprintf(stderr,"%s: no data chunk\n",path);
+      return -1;
+    }
+    if(strncmp(chunkID,"fmt ",4) == 0){
+      if(chunkSize < 16){
+	fprintf(stderr,"%s: chunkSize %d too small\n",path,chunkSize);
+	return -1;
+      }
+      uint16_t audioFormat,numChannels,blockAlign,bitsPerSample;
+      uint32_t sampleRate,byteRate;
+      if(fread(&audioFormat, sizeof(audioFormat), 1, f) != 1
+	 || fread(&numChannels, sizeof(numChannels), 1, f) != 1
+	 || fread(&sampleRate, sizeof(sampleRate), 1, f) != 1
+	 || fread(&byteRate, sizeof(byteRate), 1, f) != 1
+	 || fread(&blockAlign, sizeof(blockAlign), 1, f) != 1
+	 || fread(&bitsPerSample, sizeof(bitsPerSample), 1, f) != 1
+	 || skip_bytes(f, chunkSize - 16) != 0){
+	fprintf(stderr,"%s: premature EOF in fmt chunk\n",path);
+	return -1;
+      }
+      *audio_format = audioFormat;
+      *num_channels = numChannels;
+      *sample_rate = sampleRate;
+      *bits_per_sample = bitsPerSample;
+      have_fmt = true;
+    } else if(strncmp(chunkID,"data",4) == 0){
+      if(!have_fmt){
+	fprintf(stderr,"%s: data chunk before fmt chunk\n",path);
+	return -1;
+      }
+      *data_size = chunkSize;
+      return 0;
+    } else if(skip_bytes(f, chunkSize) != 0){
+      fprintf(stderr,"%s: premature EOF in header\n",path);
+      return -1;
+    }
+  }
+}
@@ -2,6 +2,9 @@
 #define _INCLUDE_WAVE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
 #ifdef __cplusplus
@@ -16,10 +19,40 @@ extern "C"
   // Now mallocs signal array, places in *signal, caller must free
   int load_wav(float** signal, int* num_samples, int *num_channels, int* sample_rate, const char* path,int fd);
 
-  // base_freq = radio frequency in Hz corresponding to zero frequency here (receiver is always USB)
-  // tmp = UTC @ signal[0]
-  // fsec = fractional second in UTC @ signal[0]
-  int process_buffer(float const *signal,int sample_rate, int num_samples, bool is_ft8, float base_freq, struct tm const *tmp, double fsec);
+  // Mono WAV file (16-bit PCM or 32-bit float) mapped into memory and read a block at a time,
+  // so a slot never has to be held as floats all at once
+  typedef struct {
+    const uint8_t *map;   // Whole file
+    size_t map_size;
+    const uint8_t *data;  // First sample, in place
+    int sample_rate;
+    int num_channels;
+    int audio_format;     // 1 for 16-bit PCM, 3 for 32-bit float
+    int num_frames;       // Complete samples in the data chunk (or in the file, if that's shorter)
+    int pos;              // Next sample to be read
+    bool aligned;         // data is aligned for its sample type, so wav_next() samples can be used in place
+  } wav_reader_t;
+
+  // Map a WAV file open for reading on fd and check its chunks in place. path used only for error messages
+  // The mapping doesn't need fd to stay open, but the file must not be truncated until wav_close()
+  int wav_open(wav_reader_t *me, int fd, const char *path);
+
+  // Convert up to n samples to float (-1 .. +1); returns the number converted, 0 at the end
+  int wav_read(wav_reader_t *me, float *out, int n);
+
+  // Take up to n samples in place, unconverted (int16_t or float by audio_format), setting *samples to the first
+  // Returns the number taken, 0 at the end. Dereference them directly only when me->aligned
+  int wav_next(wav_reader_t *me, int n, const void **samples);
+
+  void wav_close(wav_reader_t *me);
+
+  // Convert n little-endian 16-bit samples at any alignment to float (-1 .. +1)
+  void wav_s16_to_float(const void *in, float *out, int n);
+
+  // Read a WAVE header from a stream that may not be seekable (pipe, FIFO, file still being written)
+  // On success f is left at the first sample; *data_size is 0xffffffff if the writer didn't know the length
+  // audio_format is 1 for 16-bit PCM, 3 for 32-bit float
+  int read_wav_header(FILE *f, const char *path, int *sample_rate, int *num_channels, int *audio_format, int *bits_per_sample, uint32_t *data_size);
 
 #ifdef __cplusplus
 }
@@ -10,11 +10,16 @@
 #include <stdbool.h>
 #include <libgen.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "ft8/decode.h"
 #include "ft8/constants.h"
+#include "ft8/ldpc.h"
+#include "ft8/encode.h"
+#include "ft8/synth.h"
 
-#include "common/wave.h"
+#include "decode_ft8.h"
 #include "common/debug.h"
 #include "fft/kiss_fftr.h"
 #include "fft/kiss_fft.h"
@@ -24,6 +29,10 @@
 const int kMin_score = 10; // Minimum sync score threshold for candidates
 const int kMax_candidates = 120; // for 12 kHz sample rate; scaled for other sample rates
 const int kLDPC_iterations = 20;
+const int kDecode_batch = 16; // Candidates each thread claims and LDPC decodes together
+const int kOSD_max_errors = 20; // Only BP failures with at most this many parity errors get ordered statistics decoding
+const int kPass_candidates = 2; // Passes after the first search for 1/kPass_candidates as many candidates
+const int kNMS_waves = 3; // Candidate waves per pass; the last one takes everything still left
 
 // This used to be 50. We're now looking at some wider bandwidths *and* FT8 is pretty popular
 // Making this bigger seems to only cost memory, which I now allocate from the heap, so what the hell
@@ -31,6 +40,21 @@ const int kMax_decoded_messages = 1000;
 
 const int kFreq_osr = 2; // Frequency oversampling rate (bin subdivision)
 const int kTime_osr = 2; // Time oversampling rate (symbol subdivision)
+
+#define CACHED_DECODERS (4) // Decoders each thread keeps between files (sample rate/protocol combinations)
+#define DDC_RATE (12000) // Sample rate the -D sub-bands are decoded at
+
+int Decode_threads = 1; // Threads used to decode candidates in process_buffer(); set with -t
+bool Coarse_sync = false; // Use the coarse-to-fine sync search; set with -S
+bool Ldpc_layered = false; // Layered min-sum LDPC decoder instead of the batched flooding BP; set with -L
+int Osd_depth = 0; // Ordered statistics decoding after failed BP: 0 = off, 1 or 2; set with -O
+int Osd_budget = 100; // Most OSD attempts per slot; set with -B
+int Decode_passes = 1; // Decoding passes, with the decoded signals subtracted between them; set with -m
+bool Decode_stats = false; // Per-slot candidate and LDPC counts on stderr; set with -v
+float Freq_min = 0; // Analysis band in Hz; set with -b
+float Freq_max = 0;
+band_t Ddc_bands[MAX_DDC_BANDS]; // Sub-bands to down-convert and decode separately; set with -D
+int Num_ddc_bands = 0;
 static float hann_i(int i, int N)
 {
     float x = sinf((float)M_PI * i / N);
@@ -65,6 +89,7 @@ void waterfall_init(waterfall_t* me, int max_blocks, int num_bins, int time_osr,
     me->max_blocks = max_blocks;
     me->num_blocks = 0;
     me->num_bins = num_bins;
+    me->min_bin = 0;
     me->time_osr = time_osr;
     me->freq_osr = freq_osr;
     me->block_stride = (time_osr * freq_osr * num_bins);
@@ -77,37 +102,7 @@ void waterfall_free(waterfall_t* me)
     free(me->mag);
 }
 
-/// Configuration options for FT4/FT8 monitor
-typedef struct
-{
-    float f_min;             ///< Lower frequency bound for analysis
-    float f_max;             ///< Upper frequency bound for analysis
-    int sample_rate;         ///< Sample rate in Hertz
-    int time_osr;            ///< Number of time subdivisions
-    int freq_osr;            ///< Number of frequency subdivisions
-    ftx_protocol_t protocol; ///< Protocol: FT4 or FT8
-} monitor_config_t;
-
-/// FT4/FT8 monitor object that manages DSP processing of incoming audio data
-/// and prepares a waterfall object
-typedef struct
-{
-    float symbol_period; ///< FT4/FT8 symbol period in seconds
-    int block_size;      ///< Number of samples per symbol (block)
-    int subblock_size;   ///< Analysis shift size (number of samples)
-    int nfft;            ///< FFT size
-    float fft_norm;      ///< FFT normalization factor
-    float* window;       ///< Window function for STFT analysis (nfft samples)
-    float* last_frame;   ///< Current STFT analysis frame (nfft samples)
-    waterfall_t wf;      ///< Waterfall object
-    float max_mag;       ///< Maximum detected magnitude (debug stats)
-
-    // KISS FFT housekeeping variables
-    void* fft_work;        ///< Work area required by Kiss FFT
-    kiss_fftr_cfg fft_cfg; ///< Kiss FFT housekeeping object
-} monitor_t;
-
-void monitor_init(monitor_t* me, const monitor_config_t* cfg)
+bool monitor_init(monitor_t* me, const monitor_config_t* cfg)
 {
     float slot_time = (cfg->protocol == PROTO_FT4) ? FT4_SLOT_TIME : FT8_SLOT_TIME;
     float symbol_period = (cfg->protocol == PROTO_FT4) ? FT4_SYMBOL_PERIOD : FT8_SYMBOL_PERIOD;
@@ -118,108 +113,146 @@ void monitor_init(monitor_t* me, const monitor_config_t* cfg)
     me->fft_norm = 2.0f / me->nfft;
     // const int len_window = 1.8f * me->block_size; // hand-picked and optimized
 
-    me->window = (float *)malloc(me->nfft * sizeof(me->window[0]));
-    for (int i = 0; i < me->nfft; ++i)
-    {
-        // window[i] = 1;
-        me->window[i] = hann_i(i, me->nfft);
-        // me->window[i] = blackman_i(i, me->nfft);
-        // me->window[i] = hamming_i(i, me->nfft);
-        // me->window[i] = (i < len_window) ? hann_i(i, len_window) : 0;
-    }
-    me->last_frame = (float *)malloc(me->nfft * sizeof(me->last_frame[0]));
-
-    size_t fft_work_size;
-    kiss_fftr_alloc(me->nfft, 0, 0, &fft_work_size);
+    // Other windows: blackman_i, hamming_i
+    if (!stft_init(&me->stft, me->nfft, me->subblock_size, hann_i, me->fft_norm, cfg->fft_backend))
+        return false;
+    me->time_sub = 0;
 
     LOG(LOG_INFO, "Block size = %d\n", me->block_size);
     LOG(LOG_INFO, "Subblock size = %d\n", me->subblock_size);
-    LOG(LOG_INFO, "N_FFT = %d\n", me->nfft);
-    LOG(LOG_DEBUG, "FFT work area = %zu\n", fft_work_size);
+    LOG(LOG_INFO, "N_FFT = %d (%s)\n", me->nfft, rfft_backend_name(me->stft.fft.backend));
 
-    me->fft_work = malloc(fft_work_size);
-    me->fft_cfg = kiss_fftr_alloc(me->nfft, 0, me->fft_work, &fft_work_size);
+    // Warn once about sample rates that give slow FFT sizes
+    static atomic_bool warned_fft_size;
+    char factors[100];
+    if (rfft_factorize(me->nfft, factors, sizeof(factors)) > 5 && !atomic_exchange(&warned_fft_size, true))
+        fprintf(stderr, "Sample rate %d Hz gives FFT size %d with a large prime factor (%s); expect slow decoding\n",
+                cfg->sample_rate, me->nfft, factors);
 
     const int max_blocks = (int)(slot_time / symbol_period);
-    const int num_bins = (int)(cfg->sample_rate * symbol_period / 2);
-    waterfall_init(&me->wf, max_blocks, num_bins, cfg->time_osr, cfg->freq_osr);
+    // Keep only the bins between f_min and f_max (the whole band when f_max is 0 or past Nyquist)
+    const int nyquist_bins = (int)(cfg->sample_rate * symbol_period / 2);
+    int min_bin = (cfg->f_min > 0) ? (int)floorf(cfg->f_min * symbol_period) : 0;
+    int max_bin = (cfg->f_max > 0) ? (int)ceilf(cfg->f_max * symbol_period) : nyquist_bins;
+    if (max_bin > nyquist_bins)
+        max_bin = nyquist_bins;
+    if (max_bin - min_bin < 8)
+    {
+        // Not even room for one signal's tones
+        fprintf(stderr, "Band %.0f-%.0f Hz is too narrow, analysing 0-%d Hz\n", cfg->f_min, cfg->f_max, cfg->sample_rate / 2);
+        min_bin = 0;
+        max_bin = nyquist_bins;
+    }
+    waterfall_init(&me->wf, max_blocks, max_bin - min_bin, cfg->time_osr, cfg->freq_osr);
+    if (me->wf.mag == NULL)
+    {
+        stft_free(&me->stft);
+        return false;
+    }
+    me->wf.min_bin = min_bin;
     me->wf.protocol = cfg->protocol;
     me->symbol_period = symbol_period;
 
     me->max_mag = -120.0f;
+    me->mag_db = mag_db_select();
+    LOG(LOG_INFO, "Magnitude kernel = %s\n", mag_db_name(me->mag_db));
+    return true;
 }
 
 void monitor_free(monitor_t* me)
 {
     waterfall_free(&me->wf);
-    free(me->fft_work);
-    free(me->last_frame);
-    free(me->window);
+    stft_free(&me->stft);
 }
 
-// Compute FFT magnitudes (log wf) for a frame in the signal and update waterfall data
-void monitor_process(monitor_t* me, const float* frame)
+// Convert a spectrum to FFT magnitudes (log wf) and store them as the given block and time subdivision
+static void monitor_store_spectrum(monitor_t* me, const kiss_fft_cpx* freqdata, int block, int time_sub)
 {
-    // Check if we can still store more waterfall data
-    if (me->wf.num_blocks >= me->wf.max_blocks)
-        return;
+    int offset = (block * me->wf.block_stride) + (time_sub * me->wf.freq_osr * me->wf.num_bins);
 
-    int offset = me->wf.num_blocks * me->wf.block_stride;
-    int frame_pos = 0;
+    // Convert all the bins we use at once, then spread them over the frequency subdivisions
+    // Bin (bin * freq_osr + freq_sub) belongs to frequency subdivision freq_sub
+    const int num_src_bins = me->wf.num_bins * me->wf.freq_osr;
+    uint8_t mag[num_src_bins];
+    float max_mag2 = me->mag_db(freqdata + me->wf.min_bin * me->wf.freq_osr, num_src_bins, mag);
+    float db = 10.0f * log10f(1E-12f + max_mag2);
+    if (db > me->max_mag)
+        me->max_mag = db;
 
-    // Loop over block subdivisions
-    for (int time_sub = 0; time_sub < me->wf.time_osr; ++time_sub)
+    // Loop over two possible frequency bin offsets (for averaging)
+    for (int freq_sub = 0; freq_sub < me->wf.freq_osr; ++freq_sub)
     {
-        kiss_fft_scalar timedata[me->nfft];
-        kiss_fft_cpx freqdata[me->nfft / 2 + 1];
-
-        // Shift the new data into analysis frame
-        for (int pos = 0; pos < me->nfft - me->subblock_size; ++pos)
-        {
-            me->last_frame[pos] = me->last_frame[pos + me->subblock_size];
-        }
-        for (int pos = me->nfft - me->subblock_size; pos < me->nfft; ++pos)
+        for (int bin = 0; bin < me->wf.num_bins; ++bin)
         {
-            me->last_frame[pos] = frame[frame_pos];
-            ++frame_pos;
+            me->wf.mag[offset] = mag[(bin * me->wf.freq_osr) + freq_sub];
+            ++offset;
         }
+    }
+}
 
-        // Compute windowed analysis frame
-        for (int pos = 0; pos < me->nfft; ++pos)
-        {
-            timedata[pos] = me->fft_norm * me->window[pos] * me->last_frame[pos];
-        }
+// Compute FFT magnitudes (log wf) for the current STFT frame and store them as the next time subdivision
+static void monitor_store_frame(monitor_t* me)
+{
+    monitor_store_spectrum(me, stft_compute(&me->stft), me->wf.num_blocks, me->time_sub);
 
-        kiss_fftr(me->fft_cfg, timedata, freqdata);
+    if (++me->time_sub == me->wf.time_osr)
+    {
+        me->time_sub = 0;
+        ++me->wf.num_blocks;
+    }
+}
 
-        // Loop over two possible frequency bin offsets (for averaging)
-        for (int freq_sub = 0; freq_sub < me->wf.freq_osr; ++freq_sub)
-        {
-            for (int bin = 0; bin < me->wf.num_bins; ++bin)
-            {
-                int src_bin = (bin * me->wf.freq_osr) + freq_sub;
-                float mag2 = (freqdata[src_bin].i * freqdata[src_bin].i) + (freqdata[src_bin].r * freqdata[src_bin].r);
-                float db = 10.0f * log10f(1E-12f + mag2);
-                // Scale decibels to unsigned 8-bit range and clamp the value
-                // Range 0-240 covers -120..0 dB in 0.5 dB steps
-                int scaled = (int)(2 * db + 240);
-
-                me->wf.mag[offset] = (scaled < 0) ? 0 : ((scaled > 255) ? 255 : scaled);
-                ++offset;
-
-                if (db > me->max_mag)
-                    me->max_mag = db;
-            }
-        }
+// Feed any number of samples; a waterfall block is completed every block_size samples
+// Returns the number of samples consumed, less than n only when the waterfall is full
+int monitor_feed(monitor_t* me, const float* samples, int n)
+{
+    int consumed = 0;
+    while (consumed < n && me->wf.num_blocks < me->wf.max_blocks)
+    {
+        consumed += stft_push(&me->stft, samples + consumed, n - consumed);
+        if (stft_ready(&me->stft))
+            monitor_store_frame(me);
     }
+    return consumed;
+}
 
-    ++me->wf.num_blocks;
+// Same for 16-bit samples, which go into the STFT as they are: their 1/32768 scale is folded into the window
+int monitor_feed_s16(monitor_t* me, const int16_t* samples, int n)
+{
+    int consumed = 0;
+    while (consumed < n && me->wf.num_blocks < me->wf.max_blocks)
+    {
+        consumed += stft_push_s16(&me->stft, samples + consumed, n - consumed);
+        if (stft_ready(&me->stft))
+            monitor_store_frame(me);
+    }
+    return consumed;
+}
+
+// Compute FFT magnitudes (log wf) for a frame in the signal and update waterfall data
+void monitor_process(monitor_t* me, const float* frame)
+{
+    // Check if we can still store more waterfall data
+    if (me->wf.num_blocks >= me->wf.max_blocks)
+        return;
+
+    monitor_feed(me, frame, me->wf.time_osr * me->subblock_size);
+}
+
+void monitor_process_s16(monitor_t* me, const int16_t* frame)
+{
+    if (me->wf.num_blocks >= me->wf.max_blocks)
+        return;
+
+    monitor_feed_s16(me, frame, me->wf.time_osr * me->subblock_size);
 }
 
 void monitor_reset(monitor_t* me)
 {
     me->wf.num_blocks = 0;
-    me->max_mag = 0;
+    me->time_sub = 0;
+    me->max_mag = -120.0f;
+    stft_reset(&me->stft);
 }
 
 // Used to sort messages by ascending frequency, and to push empty entries to end
@@ -237,129 +270,734 @@ int mcompare(void const *a, void const *b){
     return +1;
   else if(ma->freq_hz < mb->freq_hz)
     return -1;
-  return 0;
+  // Same frequency: keep hash table order so the result doesn't depend on the qsort implementation
+  return (ma > mb) - (ma < mb);
 }
 
-// Process a buffer already loaded from a file
-// Pass precise time of signal[0] (including fractional second) so we can reference to it
-int process_buffer(float const *signal,int sample_rate, int num_samples, bool is_ft8, float base_freq, struct tm const *tmp, double sec){
-  assert(signal != NULL && tmp != NULL);
+// One share of a sync search, for a thread of its own
+struct sync_job {
+  waterfall_t const *wf;
+  int num_candidates;
+  int min_score;
+  ft8_sync_part_t part;
+  bool ok;
+};
 
-  LOG(LOG_INFO, "Sample rate %d Hz, %d samples, %.3f seconds\n", sample_rate, num_samples, (double)num_samples / sample_rate);
+static void *sync_worker(void *arg){
+  struct sync_job *job = arg;
+  job->ok = ft8_find_sync_part(job->wf, job->num_candidates, job->min_score, &job->part);
+  return NULL;
+}
 
-  // Compute FFT over the whole signal and store it
-  monitor_t mon = {0};
-  monitor_config_t const mon_cfg = {
-    .f_min = 100,
-    .f_max = sample_rate/2 - 500, // allow room for the receiver filter rolloff
+int find_sync_parallel(waterfall_t const *wf, int num_candidates, candidate_t heap[], int min_score, int threads){
+  ft8_sync_part_t parts[threads > 1 ? threads : 1];
+  int const num_parts = threads > 1 ? ft8_sync_split(wf, threads, parts) : 0;
+  if(num_parts > 1){
+    struct sync_job jobs[num_parts];
+    pthread_t tids[num_parts];
+    bool started[num_parts];
+    for(int i = 0; i < num_parts; i++){
+      jobs[i] = (struct sync_job){ .wf = wf, .num_candidates = num_candidates, .min_score = min_score, .part = parts[i] };
+      // The caller's thread takes the first part, and any a thread couldn't be started for
+      started[i] = i > 0 && pthread_create(&tids[i], NULL, sync_worker, &jobs[i]) == 0;
+    }
+    bool ok = true;
+    for(int i = 0; i < num_parts; i++){
+      if(started[i])
+	pthread_join(tids[i], NULL);
+      else
+	sync_worker(&jobs[i]);
+      ok = ok && jobs[i].ok;
+      parts[i] = jobs[i].part;
+    }
+    int const num = ft8_find_sync_merge(num_candidates, heap, parts, num_parts); // Frees the lists either way
+    if(ok)
+      return num;
+  }
+  return ft8_find_sync(wf, num_candidates, heap, min_score);
+}
+
+// Work shared by the candidate decoding threads
+struct decode_job {
+  waterfall_t const *wf;
+  candidate_t const *candidates;
+  float symbol_period;
+  message_t *messages; // One result per candidate, written only by the thread that decoded it
+  bool *valid;         // valid[i] set when messages[i] holds a successful decode
+  int *ldpc_errors;    // BP parity errors left on each candidate, -1 if not tried
+  int const *list;     // Indices of the candidates to decode
+  int count;
+  bool osd;            // Ordered statistics decoding instead of BP
+  atomic_int next;     // Index of the next list entry to be claimed
+};
+
+// CRC check a candidate's LDPC decode and put its payload in its result slot
+// The text is left for decoder_insert(), which unpacks only the messages that are new
+static void finish_candidate(struct decode_job *job, int idx, uint8_t const *plain174, decode_status_t *status){
+  const candidate_t* cand = &job->candidates[idx];
+  message_t *message = &job->messages[idx]; // Written by ft8_decode_plain()
+  if (!ft8_decode_plain(job->wf->protocol, plain174, message, status))
+    {
+      LOG(LOG_DEBUG, "CRC mismatch!\n");
+      return;
+    }
+  message->freq_hz = (job->wf->min_bin + cand->freq_offset + (float)cand->freq_sub / job->wf->freq_osr) / job->symbol_period; // Save so we can sort on it and display it
+  message->time_sec = (cand->time_offset + (float)cand->time_sub / job->wf->time_osr) * job->symbol_period; // Time offset of start from nominal UTC :00/:15/:30/:45 or :00/:07.5/:15/...
+  message->score = cand->score;
+  job->valid[idx] = true;
+}
+
+// Decode the candidates in list entries [first, first + count) into their own result slots,
+// running the LDPC decoder over all of them at once
+static void decode_batch(struct decode_job *job, int first, int count){
+  float log174[kDecode_batch][FTX_LDPC_N];
+  uint8_t plain174[kDecode_batch][FTX_LDPC_N];
+  int errors[kDecode_batch];
+  int idx[kDecode_batch];
+  int n = 0;
+
+  for(int i = first; i < first + count; i++){
+    int const c = job->list[i];
+    if (job->candidates[c].score < kMin_score)
+      continue;
+    ft8_extract_logl(job->wf, &job->candidates[c], log174[n]);
+    idx[n++] = c;
+  }
+  if(Ldpc_layered){
+    for(int k = 0; k < n; k++)
+      ldpc_decode_layered(log174[k], kLDPC_iterations, plain174[k], &errors[k], NULL);
+  } else
+    bp_decode_batch(log174, n, kLDPC_iterations, plain174, errors, NULL);
+
+  for(int k = 0; k < n; k++){
+    decode_status_t status = { .ldpc_errors = errors[k] };
+    job->ldpc_errors[idx[k]] = errors[k];
+    if (status.ldpc_errors > 0)
+      {
+	LOG(LOG_DEBUG, "LDPC decode: %d errors\n", status.ldpc_errors);
+	continue;
+      }
+    finish_candidate(job, idx[k], plain174[k], &status);
+  }
+}
+
+// Second chance for a BP near miss: the closest codeword by ordered statistics, if its CRC checks
+static void osd_candidate(struct decode_job *job, int idx){
+  float log174[FTX_LDPC_N];
+  uint8_t plain174[FTX_LDPC_N];
+  ft8_extract_logl(job->wf, &job->candidates[idx], log174);
+  osd_decode(log174, Osd_depth, plain174, NULL);
+  decode_status_t status = {0};
+  finish_candidate(job, idx, plain174, &status);
+}
+
+static void *decode_worker(void *arg){
+  struct decode_job *job = arg;
+  if(job->osd){
+    int i;
+    while((i = atomic_fetch_add(&job->next, 1)) < job->count)
+      osd_candidate(job, job->list[i]);
+    return NULL;
+  }
+  int first;
+  while((first = atomic_fetch_add(&job->next, kDecode_batch)) < job->count){
+    int count = job->count - first;
+    if(count > kDecode_batch)
+      count = kDecode_batch;
+    decode_batch(job, first, count);
+  }
+  return NULL;
+}
+
+// Decode every candidate on the job's list using up to 'threads' threads, including the caller's
+static void decode_candidates(struct decode_job *job, int threads){
+  atomic_store(&job->next, 0);
+  int const units = job->osd ? job->count : (job->count + kDecode_batch - 1) / kDecode_batch;
+  if(threads > units)
+    threads = units;
+  pthread_t tids[threads > 1 ? threads - 1 : 1];
+  int started = 0;
+  for(; started < threads - 1; started++){
+    if(pthread_create(&tids[started], NULL, decode_worker, job) != 0)
+      break; // Carry on with what we have; the caller's thread always participates
+  }
+  decode_worker(job);
+  for(int i = 0; i < started; i++)
+    pthread_join(tids[i], NULL);
+}
+
+
+bool decoder_init(ft8_decoder_t* me, int sample_rate, bool is_ft8){
+  return decoder_init_band(me, sample_rate, is_ft8, Freq_min, Freq_max);
+}
+
+bool decoder_init_band(ft8_decoder_t* me, int sample_rate, bool is_ft8, float f_min, float f_max){
+  memset(me, 0, sizeof *me);
+  me->cfg = (monitor_config_t){
+    .f_min = f_min,
+    .f_max = f_max,
     .sample_rate = sample_rate,
     .time_osr = kTime_osr,
     .freq_osr = kFreq_osr,
-    .protocol = is_ft8 ? PROTO_FT8 : PROTO_FT4
+    .protocol = is_ft8 ? PROTO_FT8 : PROTO_FT4,
+    .fft_backend = Rfft_default_backend,
   };
-  monitor_init(&mon, &mon_cfg);
-  LOG(LOG_DEBUG, "Waterfall allocated %d symbols\n", mon.wf.max_blocks);
-  for (int frame_pos = 0; frame_pos + mon.block_size <= num_samples; frame_pos += mon.block_size)
-    {
-      // Process the waveform data frame by frame - you could have a live loop here with data from an audio device
-      // (cool, now that we can get sample timings - KA9Q)
-      monitor_process(&mon, signal + frame_pos);
+  if(!monitor_init(&me->mon, &me->cfg)){
+    decoder_free(me);
+    return false;
+  }
+  LOG(LOG_DEBUG, "Waterfall allocated %d symbols\n", me->mon.wf.max_blocks);
+
+  // Scale by bandwidth relative to the original 3 kHz, allowing 500 Hz at the top for the receiver filter rolloff
+  float top = sample_rate/2 - 500;
+  if(me->cfg.f_max > 0 && me->cfg.f_max < top)
+    top = me->cfg.f_max;
+  me->candidate_size = ((top - me->cfg.f_min) * kMax_candidates) / 3000;
+  if(me->candidate_size < 1)
+    me->candidate_size = 1;
+  me->candidates = calloc(sizeof(candidate_t), me->candidate_size);
+  me->messages = calloc(sizeof(message_t), me->candidate_size);
+  me->valid = calloc(sizeof(bool), me->candidate_size);
+  me->ldpc_errors = calloc(sizeof(int), me->candidate_size);
+  me->picked = calloc(sizeof(int), me->candidate_size);
+  // Pointer to kMax_decoded_messages-element array of message_t structures
+  me->decoded = calloc(sizeof(message_t), kMax_decoded_messages);
+  // Pointer to kMax_decoded_messsages-element array of pointers to message_t structures
+  me->decoded_hashtable = calloc(sizeof(message_t *), kMax_decoded_messages);
+  me->printed = calloc(sizeof(bool), kMax_decoded_messages);
+  me->subtracted = calloc(sizeof(bool), kMax_decoded_messages);
+  if(Decode_passes > 1){
+    // Keep the slot's audio so decoded signals can be subtracted from it
+    me->audio_size = me->mon.wf.max_blocks * me->mon.block_size;
+    me->audio = malloc(sizeof(float) * me->audio_size);
+    if(me->audio == NULL){
+      decoder_free(me);
+      return false;
     }
-  LOG(LOG_DEBUG, "Waterfall accumulated %d symbols\n", mon.wf.num_blocks);
-  LOG(LOG_INFO, "Max magnitude: %.1f dB\n", mon.max_mag);
+  }
+  if(me->candidates == NULL || me->messages == NULL || me->valid == NULL || me->ldpc_errors == NULL || me->picked == NULL
+     || me->decoded == NULL || me->decoded_hashtable == NULL || me->printed == NULL || me->subtracted == NULL){
+    decoder_free(me);
+    return false;
+  }
+  return true;
+}
+
+void decoder_free(ft8_decoder_t* me){
+  monitor_free(&me->mon);
+  free(me->candidates);
+  free(me->messages);
+  free(me->valid);
+  free(me->ldpc_errors);
+  free(me->picked);
+  free(me->decoded);
+  free(me->decoded_hashtable);
+  free(me->printed);
+  free(me->subtracted);
+  free(me->audio);
+  memset(me, 0, sizeof *me);
+}
+
+void decoder_reset(ft8_decoder_t* me){
+  monitor_reset(&me->mon);
+  memset(me->decoded_hashtable, 0, sizeof(message_t *) * kMax_decoded_messages);
+  memset(me->printed, 0, sizeof(bool) * kMax_decoded_messages);
+  memset(me->subtracted, 0, sizeof(bool) * kMax_decoded_messages);
+  me->num_decoded = 0;
+  me->osd_used = 0;
+  me->num_sync = 0;
+  me->ldpc_runs = 0;
+  me->ldpc_skipped = 0;
+  me->num_payloads = 0;
+  me->num_unpacked = 0;
+  me->audio_len = 0;
+}
+
+// Each thread's decoders, kept between files so the window, FFT plan and buffers are set up only once
+// per (sample rate, protocol, oversampling) instead of on every file
+static _Thread_local struct {
+  ft8_decoder_t dec;
+  bool valid;
+  unsigned last_use; // For evicting the least recently used
+} Decoder_cache[CACHED_DECODERS];
+static _Thread_local unsigned Decoder_uses;
+
+ft8_decoder_t *decoder_get(int sample_rate, bool is_ft8){
+  ftx_protocol_t const protocol = is_ft8 ? PROTO_FT8 : PROTO_FT4;
+  int victim = -1;
+  for(int i = 0; i < CACHED_DECODERS; i++){
+    ft8_decoder_t *dec = &Decoder_cache[i].dec;
+    // The options set at startup shape the decoder too, so they're part of the key
+    if(Decoder_cache[i].valid && dec->cfg.sample_rate == sample_rate && dec->cfg.protocol == protocol
+       && dec->cfg.time_osr == kTime_osr && dec->cfg.freq_osr == kFreq_osr
+       && dec->cfg.fft_backend == Rfft_default_backend && (dec->audio != NULL) == (Decode_passes > 1)
+       && dec->cfg.f_min == Freq_min && dec->cfg.f_max == Freq_max){
+      Decoder_cache[i].last_use = ++Decoder_uses;
+      decoder_reset(dec);
+      return dec;
+    }
+    // Otherwise replace an empty entry, or failing that the least recently used
+    if(victim == -1 || (Decoder_cache[victim].valid
+			&& (!Decoder_cache[i].valid || Decoder_cache[i].last_use < Decoder_cache[victim].last_use)))
+      victim = i;
+  }
+  if(Decoder_cache[victim].valid)
+    decoder_free(&Decoder_cache[victim].dec);
+  Decoder_cache[victim].valid = decoder_init(&Decoder_cache[victim].dec, sample_rate, is_ft8);
+  if(!Decoder_cache[victim].valid)
+    return NULL;
+  Decoder_cache[victim].last_use = ++Decoder_uses;
+  return &Decoder_cache[victim].dec;
+}
+
+void decoder_cache_free(void){
+  for(int i = 0; i < CACHED_DECODERS; i++){
+    if(Decoder_cache[i].valid)
+      decoder_free(&Decoder_cache[i].dec);
+    Decoder_cache[i].valid = false;
+  }
+}
+
+int decoder_feed(ft8_decoder_t* me, const float* samples, int n){
+  int const consumed = monitor_feed(&me->mon, samples, n);
+  if(me->audio != NULL){
+    int const keep = consumed < me->audio_size - me->audio_len ? consumed : me->audio_size - me->audio_len;
+    memcpy(me->audio + me->audio_len, samples, sizeof(float) * keep);
+    me->audio_len += keep;
+  }
+  return consumed;
+}
+
+int decoder_feed_s16(ft8_decoder_t* me, const int16_t* samples, int n){
+  int const consumed = monitor_feed_s16(&me->mon, samples, n);
+  if(me->audio != NULL){
+    // Subtraction works on floats, so only the multi-pass copy is converted
+    int const keep = consumed < me->audio_size - me->audio_len ? consumed : me->audio_size - me->audio_len;
+    wav_s16_to_float(samples, me->audio + me->audio_len, keep);
+    me->audio_len += keep;
+  }
+  return consumed;
+}
+
+float decoder_seconds(const ft8_decoder_t* me){
+  return me->mon.wf.num_blocks * me->mon.symbol_period;
+}
 
+bool decoder_full(const ft8_decoder_t* me){
+  return me->mon.wf.num_blocks >= me->mon.wf.max_blocks;
+}
+
+// Add a message to the slot's hash table unless it's already there
+// Duplicates are recognized by their binary payload, so only a new message is unpacked in plain text
+// Returns true if it was new
+static bool decoder_insert(ft8_decoder_t* me, message_t const *message){
+  LOG(LOG_DEBUG, "Checking hash table for %4.1fs / %4.1fHz [%d]...\n", message->time_sec, message->freq_hz, message->score);
+  me->num_payloads++;
+  int idx_hash = message->hash % kMax_decoded_messages;
+  for(int probes = 0; probes < kMax_decoded_messages; probes++){
+    if (me->decoded_hashtable[idx_hash] == NULL)
+      {
+	LOG(LOG_DEBUG, "Found an empty slot\n");
+	// Fill the empty hashtable slot, if the payload makes sense
+	me->decoded[idx_hash] = *message;
+	me->num_unpacked++;
+	if(!ft8_unpack_message(&me->decoded[idx_hash], NULL)){
+	  LOG(LOG_DEBUG, "Error while unpacking!\n");
+	  return false;
+	}
+	me->decoded_hashtable[idx_hash] = &me->decoded[idx_hash];
+	me->printed[idx_hash] = false;
+	me->subtracted[idx_hash] = false;
+	me->num_decoded++;
+	return true;
+      }
+    if (ft8_same_message(me->decoded_hashtable[idx_hash], message))
+      {
+	LOG(LOG_DEBUG, "Found a duplicate [%s]\n", me->decoded_hashtable[idx_hash]->text);
+	return false;
+      }
+    LOG(LOG_DEBUG, "Hash table clash!\n");
+    // Move on to check the next entry in hash table
+    idx_hash = (idx_hash + 1) % kMax_decoded_messages;
+  }
+  return false; // Table full; several passes over a very busy band could get here
+}
+
+// Pick the BP near misses worth an OSD attempt, fewest parity errors first, up to what's left of the budget.
+// Candidates right next to one that decoded are skipped: they're nearly always the same signal again
+static int select_osd(ft8_decoder_t* me, int num_candidates){
+  if(Osd_depth <= 0)
+    return 0;
+  int n = 0;
+  for(int idx = 0; idx < num_candidates; idx++){
+    int const errors = me->ldpc_errors[idx];
+    if(me->valid[idx] || errors <= 0 || errors > kOSD_max_errors)
+      continue;
+    candidate_t const *cand = &me->candidates[idx];
+    bool near = false;
+    for(int j = 0; j < num_candidates && !near; j++){
+      candidate_t const *c = &me->candidates[j];
+      near = me->valid[j] && abs(c->time_offset - cand->time_offset) <= 1 && abs(c->freq_offset - cand->freq_offset) <= 1;
+    }
+    if(near)
+      continue;
+    // Insertion sort on (errors, index) keeps the choice deterministic
+    int k = n++;
+    for(; k > 0 && me->ldpc_errors[me->picked[k-1]] > errors; k--)
+      me->picked[k] = me->picked[k-1];
+    me->picked[k] = idx;
+  }
+  int const left = Osd_budget - me->osd_used;
+  return n < left ? n : (left > 0 ? left : 0);
+}
+
+// Search the waterfall once for at most max_candidates sync candidates and decode them
+// Returns the number of new messages
+static int decode_pass(ft8_decoder_t* me, int max_candidates){
   // Find top candidates by Costas sync score and localize them in time and frequency
-  int const candidate_size = (mon_cfg.f_max * kMax_candidates) / 3000; // Scale by bandwidth relative to the original 3 kHz
-  candidate_t candidate_list[candidate_size];
-  int num_candidates = ft8_find_sync(&mon.wf, candidate_size, candidate_list, kMin_score);
+  int num_candidates = Coarse_sync
+    ? ft8_find_sync_coarse(&me->mon.wf, max_candidates, me->candidates, kMin_score, 0)
+    : find_sync_parallel(&me->mon.wf, max_candidates, me->candidates, kMin_score, Decode_threads);
 
-  // Hash table for decoded messages (to check for duplicates)
+  // Decode the candidates, possibly in parallel. Each candidate gets its own result slot
+  // so the threads never touch shared state; duplicates are merged afterward in candidate order,
+  // which gives exactly the same output as decoding them one at a time
+  memset(me->valid, 0, sizeof(bool) * me->candidate_size);
+  for (int idx = 0; idx < num_candidates; ++idx)
+    me->ldpc_errors[idx] = -1;
+  struct decode_job job = {
+    .wf = &me->mon.wf,
+    .candidates = me->candidates,
+    .symbol_period = me->mon.symbol_period,
+    .messages = me->messages,
+    .valid = me->valid,
+    .ldpc_errors = me->ldpc_errors,
+    .list = me->picked,
+  };
+  atomic_init(&job.next, 0);
+
+  // The sync search reports a cluster of candidates around every signal, one subdivision apart in time
+  // and frequency, and all those that decode give the same message. So decode in waves: first the
+  // candidates with no stronger neighbor left (non-maximum suppression), then, of the rest, only those
+  // that aren't beside a signal decoded by now, in this pass or an earlier one
+  int const time_osr = me->mon.wf.time_osr;
+  int const freq_osr = me->mon.wf.freq_osr;
+  int decoded_t[kMax_decoded_messages + num_candidates]; // Positions of the decoded signals, in subdivisions
+  int decoded_f[kMax_decoded_messages + num_candidates];
   int num_decoded = 0;
-  // Pointer to kMax_decoded_messages-element array of message_t structures
-  message_t *decoded = calloc(sizeof(message_t), kMax_decoded_messages);
-  // Pointer to kMax_decoded_messsages-element array of pointers to message_t structures
-  message_t **decoded_hashtable = calloc(sizeof(message_t *), kMax_decoded_messages);
+  for(int i = 0; i < kMax_decoded_messages; i++){
+    message_t const *mp = me->decoded_hashtable[i];
+    if(mp == NULL)
+      continue;
+    decoded_t[num_decoded] = (int)lrintf(mp->time_sec / me->mon.symbol_period * time_osr);
+    decoded_f[num_decoded++] = (int)lrintf(mp->freq_hz * me->mon.symbol_period * freq_osr) - me->mon.wf.min_bin * freq_osr;
+  }
+  bool done[num_candidates > 0 ? num_candidates : 1];
+  memset(done, 0, sizeof done);
+  for(int wave = 0; wave < kNMS_waves; wave++){
+    job.count = 0;
+    for(int idx = 0; idx < num_candidates; idx++){
+      if(done[idx])
+	continue;
+      candidate_t const *cand = &me->candidates[idx];
+      int const t = cand->time_offset * time_osr + cand->time_sub;
+      int const f = cand->freq_offset * freq_osr + cand->freq_sub;
+      bool beside = false;
+      for(int j = 0; j < num_decoded && !beside; j++)
+	beside = abs(decoded_t[j] - t) <= 1 && abs(decoded_f[j] - f) <= 1;
+      if(beside){
+	done[idx] = true;
+	me->ldpc_skipped++;
+	continue;
+      }
+      // Candidates come strongest first, so a neighbor already in this wave is stronger
+      bool suppressed = false;
+      for(int k = 0; k < job.count && !suppressed && wave < kNMS_waves - 1; k++){
+	candidate_t const *c = &me->candidates[me->picked[k]];
+	suppressed = abs(c->time_offset * time_osr + c->time_sub - t) <= 1 && abs(c->freq_offset * freq_osr + c->freq_sub - f) <= 1;
+      }
+      if(suppressed)
+	continue;
+      done[idx] = true;
+      me->picked[job.count++] = idx;
+    }
+    if(job.count == 0)
+      break;
+    decode_candidates(&job, Decode_threads);
+    me->ldpc_runs += job.count;
+    for(int k = 0; k < job.count; k++){
+      int const idx = me->picked[k];
+      if(!me->valid[idx])
+	continue;
+      decoded_t[num_decoded] = me->candidates[idx].time_offset * time_osr + me->candidates[idx].time_sub;
+      decoded_f[num_decoded++] = me->candidates[idx].freq_offset * freq_osr + me->candidates[idx].freq_sub;
+    }
+  }
+  me->num_sync += num_candidates;
+
+  // Then OSD on the closest BP failures, while the slot's budget lasts
+  int const num_osd = select_osd(me, num_candidates);
+  if (num_osd > 0)
+    {
+      job.count = num_osd;
+      job.osd = true;
+      decode_candidates(&job, Decode_threads);
+      me->osd_used += num_osd;
+    }
 
-  // Go over candidates and attempt to decode messages
+  // Merge the successful decodes in candidate order
+  int num_new = 0;
   for (int idx = 0; idx < num_candidates; ++idx)
     {
-      const candidate_t* cand = &candidate_list[idx];
-      if (cand->score < kMin_score)
+      if (me->valid[idx] && decoder_insert(me, &me->messages[idx]))
+	num_new++;
+    }
+  LOG(LOG_INFO, "Decoded %d messages, %d new\n", me->num_decoded, num_new);
+  return num_new;
+}
+
+static bool is_sync_symbol(ftx_protocol_t protocol, int s){
+  if(protocol == PROTO_FT8)
+    return s % FT8_SYNC_OFFSET < FT8_LENGTH_SYNC;
+  return s > 0 && (s - 1) % FT4_SYNC_OFFSET < FT4_LENGTH_SYNC;
+}
+
+// Correlate audio[start, start + n) with the in-phase and quadrature references
+// Samples outside the audio count as zero
+static void correlate(float const *audio, int audio_len, int start, float const *ref_c, float const *ref_s, int n, float *a, float *b){
+  int const lo = start < 0 ? -start : 0;
+  int const hi = start + n > audio_len ? audio_len - start : n;
+  // Four partial sums each so the additions can overlap
+  float sa[4] = {0}, sb[4] = {0};
+  int k = lo;
+  for(; k + 4 <= hi; k += 4){
+    for(int j = 0; j < 4; j++){
+      sa[j] += audio[start + k + j] * ref_c[k + j];
+      sb[j] += audio[start + k + j] * ref_s[k + j];
+    }
+  }
+  for(; k < hi; k++){
+    sa[0] += audio[start + k] * ref_c[k];
+    sb[0] += audio[start + k] * ref_s[k];
+  }
+  *a = (sa[0] + sa[1]) + (sa[2] + sa[3]);
+  *b = (sb[0] + sb[1]) + (sb[2] + sb[3]);
+}
+
+// sin(x) for |x| <= pi: fold into [-pi/2, pi/2] and use the Taylor series to x^11 (error < 1e-7)
+// The folds multiply by quiet comparison results instead of branching so loops calling this vectorize
+static inline float sin_pi(float x){
+  float const pi = M_PI, half_pi = M_PI / 2;
+  x += isgreater(x, half_pi) * (pi - 2 * x) + isless(x, -half_pi) * (-pi - 2 * x);
+  float const x2 = x * x;
+  return x * (1 + x2 * (-1.0f/6 + x2 * (1.0f/120 + x2 * (-1.0f/5040 + x2 * (1.0f/362880 + x2 * (-1.0f/39916800))))));
+}
+
+// Quadrature references cos and sin of (phase[k] + theta + dw * k) for k in [0, n),
+// phase[] in [0, 2 pi), |theta| <= pi and |dw * n| <= pi
+// Polynomials rather than sincosf() so the loop vectorizes
+static void make_reference(float const *phase, int n, float theta, float dw, float *ref_c, float *ref_s){
+  float const pi = M_PI, two_pi = 2 * M_PI, half_pi = M_PI / 2;
+  for(int k = 0; k < n; k++){
+    float x = phase[k] + theta + dw * k; // (-2 pi, 4 pi)
+    x -= (isgreater(x, pi) + isgreater(x, 3 * pi) - isless(x, -pi)) * two_pi;
+    float xc = x + half_pi;
+    xc -= isgreater(xc, pi) * two_pi;
+    ref_s[k] = sin_pi(x);
+    ref_c[k] = sin_pi(xc);
+  }
+}
+
+// Regenerate a decoded message's waveform, fit it to the audio and subtract it
+// The timing is refined to hop/8 and the frequency error measured on the sync symbols alone; then the
+// amplitude and phase are estimated symbol by symbol over the whole message so fading and drift are
+// followed. phase, ref_c and ref_s need room for one whole waveform
+// Marks the waterfall frames (blocks * time_osr) the signal overlaps in dirty[]
+static bool subtract_message(ft8_decoder_t *me, message_t const *msg, float *phase, float *ref_c, float *ref_s, bool *dirty){
+  ftx_protocol_t const protocol = me->cfg.protocol;
+  int const n_sym = protocol == PROTO_FT8 ? FT8_NN : FT4_NN;
+  uint8_t tones[FT4_NN]; // The longer of the two
+  if(protocol == PROTO_FT8)
+    ft8_encode(msg->payload, tones);
+  else
+    ft4_encode(msg->payload, tones);
+
+  int const n_wave = synth_gfsk_phase(tones, n_sym, msg->freq_hz, protocol == PROTO_FT8 ? FT8_SYMBOL_BT : FT4_SYMBOL_BT,
+				      me->mon.symbol_period, me->cfg.sample_rate, phase);
+  if(n_wave <= 0)
+    return false;
+  int const nsps = n_wave / n_sym;
+  for(int s = 0; s < n_sym; s++){
+    if(!is_sync_symbol(protocol, s))
+      continue;
+    make_reference(phase + s * nsps, nsps, 0, 0, ref_c + s * nsps, ref_s + s * nsps);
+  }
+  // Nominal start: the sync search puts the first symbol's center at the center of frame 'frame0'
+  int const hop = me->mon.subblock_size;
+  int const frame0 = (int)lrintf(msg->time_sec / me->mon.symbol_period * me->cfg.time_osr);
+  int start = (frame0 + 1) * hop - me->mon.nfft / 2 - nsps / 2;
+
+  // Refine the timing to within hop/8 on the sync symbols' energy
+  int const step = hop >= 8 ? hop / 8 : 1;
+  float best = 0;
+  int best_start = start;
+  for(int d = -hop / 2; d <= hop / 2; d += step){
+    float energy = 0;
+    for(int s = 0; s < n_sym; s++){
+      if(!is_sync_symbol(protocol, s))
 	continue;
+      float a, b;
+      correlate(me->audio, me->audio_len, start + d + s * nsps, ref_c + s * nsps, ref_s + s * nsps, nsps, &a, &b);
+      energy += a * a + b * b;
+    }
+    if(energy > best){
+      best = energy;
+      best_start = start + d;
+    }
+  }
+  if(best <= 0)
+    return false; // Entirely outside the audio
+  start = best_start;
 
-      float const freq_hz = (cand->freq_offset + (float)cand->freq_sub / mon.wf.freq_osr) / mon.symbol_period;
-      float const time_sec = (cand->time_offset + (float)cand->time_sub / mon.wf.time_osr) * mon.symbol_period;
+  // Symbol amplitudes: audio ~ A cos(phase) + B sin(phase)
+  // A frequency error shows up as a steady phase advance of A - jB from one sync symbol to the next
+  float A[FT4_NN], B[FT4_NN];
+  double re = 0, im = 0;
+  for(int s = 0; s < n_sym; s++){
+    if(!is_sync_symbol(protocol, s))
+      continue;
+    correlate(me->audio, me->audio_len, start + s * nsps, ref_c + s * nsps, ref_s + s * nsps, nsps, &A[s], &B[s]);
+    if(s > 0 && is_sync_symbol(protocol, s - 1)){
+      re += A[s] * A[s-1] + B[s] * B[s-1];
+      im += A[s] * B[s-1] - B[s] * A[s-1];
+    }
+  }
+  // Now the references for the whole message, with the frequency corrected
+  double const dw = (re != 0 || im != 0) ? atan2(im, re) / nsps : 0; // Radians per sample
+  for(int s = 0; s < n_sym; s++)
+    make_reference(phase + s * nsps, nsps, remainder(dw * s * nsps, 2 * M_PI), dw, ref_c + s * nsps, ref_s + s * nsps);
+  float const scale = 2.0f / nsps;
+  for(int s = 0; s < n_sym; s++){
+    correlate(me->audio, me->audio_len, start + s * nsps, ref_c + s * nsps, ref_s + s * nsps, nsps, &A[s], &B[s]);
+    A[s] *= scale;
+    B[s] *= scale;
+  }
+  // Subtract symbol by symbol. Smoothing the estimates across symbols or interpolating between them
+  // leaves more behind: the per-symbol fit follows fading and the GFSK transitions better
+  for(int s = 0; s < n_sym; s++){
+    int lo = s * nsps;
+    int hi = lo + nsps;
+    if(start + lo < 0)
+      lo = -start;
+    if(start + hi > me->audio_len)
+      hi = me->audio_len - start;
+    float *out = me->audio + start;
+    for(int k = lo; k < hi; k++)
+      out[k] -= A[s] * ref_c[k] + B[s] * ref_s[k];
+  }
+  // Frame f covers samples [(f + 1) * hop - nfft, (f + 1) * hop)
+  int const num_frames = me->mon.wf.num_blocks * me->mon.wf.time_osr;
+  for(int f = 0; f < num_frames; f++){
+    if((f + 1) * hop > start && (f + 1) * hop - me->mon.nfft < start + n_wave)
+      dirty[f] = true;
+  }
+  return true;
+}
 
-      message_t message = {0}; // Written by ft8_decode()
-      decode_status_t status = {0}; // ditto
-      if (!ft8_decode(&mon.wf, cand, &message, kLDPC_iterations, &status))
-        {
-	  // printf("000000 %3d %+4.2f %4.0f ~  ---\n", cand->score, time_sec, freq_hz);
-	  if (status.ldpc_errors > 0)
-            {
-	      LOG(LOG_DEBUG, "LDPC decode: %d errors\n", status.ldpc_errors);
-            }
-	  else if (status.crc_calculated != status.crc_extracted)
-            {
-	      LOG(LOG_DEBUG, "CRC mismatch!\n");
-            }
-	  else if (status.unpack_status != 0)
-            {
-	      LOG(LOG_DEBUG, "Error while unpacking!\n");
-            }
-	  continue;
-        }
+// Subtract the decoded messages not yet subtracted, strongest first, and recompute the
+// waterfall frames they overlap. Returns the number of messages subtracted
+static int subtract_decoded(ft8_decoder_t *me){
+  int list[kMax_decoded_messages];
+  int count = 0;
+  for(int i = 0; i < kMax_decoded_messages; i++){
+    if(me->decoded_hashtable[i] == NULL || me->subtracted[i])
+      continue;
+    // Insertion sort by descending score, then table order
+    int k = count++;
+    for(; k > 0 && me->decoded[list[k-1]].score < me->decoded[i].score; k--)
+      list[k] = list[k-1];
+    list[k] = i;
+  }
+  if(count == 0)
+    return 0;
 
-      message.freq_hz = freq_hz; // Save so we can sort on it and display it
-      message.time_sec = time_sec; // Time offset of start from nominal UTC :00/:15/:30/:45 or :00/:07.5/:15/...
-      message.score = cand->score;
+  int const n_spsym = (int)(0.5f + me->cfg.sample_rate * me->mon.symbol_period); // As in synth_gfsk_phase()
+  int const max_wave = FT4_NN * n_spsym;
+  int const num_frames = me->mon.wf.num_blocks * me->mon.wf.time_osr;
+  float *phase = malloc(sizeof(float) * max_wave);
+  float *ref_c = malloc(sizeof(float) * max_wave);
+  float *ref_s = malloc(sizeof(float) * max_wave);
+  float *frame = malloc(sizeof(float) * me->mon.nfft);
+  bool *dirty = calloc(sizeof(bool), num_frames > 0 ? num_frames : 1);
+  int subtracted = 0;
+  if(phase != NULL && ref_c != NULL && ref_s != NULL && frame != NULL && dirty != NULL){
+    for(int i = 0; i < count; i++){
+      me->subtracted[list[i]] = true; // Don't try it again even if it didn't fit
+      if(subtract_message(me, &me->decoded[list[i]], phase, ref_c, ref_s, dirty))
+	subtracted++;
+    }
+    // Recompute only the frames that changed
+    int const hop = me->mon.subblock_size;
+    for(int f = 0; f < num_frames; f++){
+      if(!dirty[f])
+	continue;
+      int const first = (f + 1) * hop - me->mon.nfft;
+      for(int k = 0; k < me->mon.nfft; k++)
+	frame[k] = (first + k >= 0 && first + k < me->audio_len) ? me->audio[first + k] : 0;
+      monitor_store_spectrum(&me->mon, stft_compute_frame(&me->mon.stft, frame), f / me->mon.wf.time_osr, f % me->mon.wf.time_osr);
+    }
+  }
+  free(phase);
+  free(ref_c);
+  free(ref_s);
+  free(frame);
+  free(dirty);
+  LOG(LOG_INFO, "Subtracted %d messages\n", subtracted);
+  return subtracted;
+}
 
-      LOG(LOG_DEBUG, "Checking hash table for %4.1fs / %4.1fHz [%d]...\n", time_sec, freq_hz, cand->score);
-      int idx_hash = message.hash % kMax_decoded_messages;
-      bool found_empty_slot = false;
-      bool found_duplicate = false;
-      do
-        {
-	  if (decoded_hashtable[idx_hash] == NULL)
-            {
-	      LOG(LOG_DEBUG, "Found an empty slot\n");
-	      found_empty_slot = true;
-            }
-	  else if ((decoded_hashtable[idx_hash]->hash == message.hash) && (0 == strcmp(decoded_hashtable[idx_hash]->text, message.text)))
-            {
-	      LOG(LOG_DEBUG, "Found a duplicate [%s]\n", message.text);
-	      found_duplicate = true;
-            }
-	  else
-            {
-	      LOG(LOG_DEBUG, "Hash table clash!\n");
-	      // Move on to check the next entry in hash table
-	      idx_hash = (idx_hash + 1) % kMax_decoded_messages;
-            }
-        } while (!found_empty_slot && !found_duplicate);
-
-      if (found_empty_slot)
-        {
-	  // Fill the empty hashtable slot
-	  decoded[idx_hash] = message;
-	  decoded_hashtable[idx_hash] = &decoded[idx_hash];
-	  ++num_decoded;
+int decoder_decode(ft8_decoder_t* me){
+  LOG(LOG_DEBUG, "Waterfall accumulated %d symbols\n", me->mon.wf.num_blocks);
+  LOG(LOG_INFO, "Max magnitude: %.1f dB\n", me->mon.max_mag);
 
-        }
+  int num_new = decode_pass(me, me->candidate_size);
+
+  // Later passes look for weaker signals hidden under the ones already decoded, with fewer candidates each.
+  // The audio only lines up with the waterfall once the slot is complete
+  for(int pass = 1; pass < Decode_passes && me->audio != NULL && decoder_full(me); pass++){
+    if(subtract_decoded(me) == 0)
+      break;
+    int const found = decode_pass(me, me->candidate_size / kPass_candidates);
+    num_new += found;
+    if(found == 0)
+      break;
+  }
+  if(Decode_stats)
+    fprintf(stderr, "%d sync candidates, %d LDPC decodes, %d skipped beside decoded signals, %d decodes, %d unpacked\n",
+	    me->num_sync, me->ldpc_runs, me->ldpc_skipped, me->num_payloads, me->num_unpacked);
+  return num_new;
+}
+
+int decoder_print(ft8_decoder_t* me, double base_freq, struct tm const *tmp, double sec){
+  // Decoded messages are spread throughout the hash table, which must stay intact for later passes,
+  // so sort a list of the ones not yet printed
+  message_t const *list[kMax_decoded_messages];
+  int count = 0;
+  for(int i=0; i < kMax_decoded_messages; i++){
+    if(me->decoded_hashtable[i] != NULL && !me->printed[i]){
+      list[count++] = me->decoded_hashtable[i];
+      me->printed[i] = true;
     }
-  LOG(LOG_INFO, "Decoded %d messages\n", num_decoded);
-  // Decoded messages are spread throughout hash table, so sort the whole thing including null entries
-  qsort(decoded_hashtable, kMax_decoded_messages, sizeof *decoded_hashtable, mcompare);
-  // Empty entries sorted to top, so first num_decoded elements of decoded_hashtable are valid
+  }
+  qsort(list, count, sizeof list[0], mcompare);
+
   double tbase = tmp->tm_sec; // Full seconds and fraction in minute, should be just above (not below) period multiple
-  tbase = is_ft8 ? fmod(tbase,15.0) : fmod(tbase,7.5); // seconds after start of cycle (0/15/30/45 or 0/7.5/15/etc)
+  tbase = me->cfg.protocol == PROTO_FT8 ? fmod(tbase,15.0) : fmod(tbase,7.5); // seconds after start of cycle (0/15/30/45 or 0/7.5/15/etc)
   tbase += sec; // sec could be negative, so add it only now
 
-  for(int i=0; i < num_decoded; i++){
-    message_t const *mp = decoded_hashtable[i];
-    if(mp == NULL)
-      continue; // Shouldn't happen
-
+  flockfile(stdout); // Keep each file's decodes together when several files are decoded at once
+  for(int i=0; i < count; i++){
+    message_t const *mp = list[i];
     fprintf(stdout,"%4d/%02d/%02d %02d:%02d:%02d %3d %+4.2lf %'.1lf ~ %s\n",
 	    tmp->tm_year + 1900,
 	    tmp->tm_mon + 1,
@@ -372,9 +1010,189 @@ int process_buffer(float const *signal,int sample_rate, int num_samples, bool is
 	    1.0e6 * base_freq + mp->freq_hz,
 	    mp->text);
   }
-  free(decoded);
-  free(decoded_hashtable);
+  fflush(stdout);
+  funlockfile(stdout);
+  return count;
+}
+
+// Process a buffer already loaded from a file
+// Pass precise time of signal[0] (including fractional second) so we can reference to it
+int process_buffer(float const *signal,int sample_rate, int num_samples, bool is_ft8, float base_freq, struct tm const *tmp, double sec){
+  assert(signal != NULL && tmp != NULL);
+
+  LOG(LOG_INFO, "Sample rate %d Hz, %d samples, %.3f seconds\n", sample_rate, num_samples, (double)num_samples / sample_rate);
+
+  // Compute FFT over the whole signal and store it
+  if(Num_ddc_bands > 0)
+    return process_bands(signal, num_samples, sample_rate, NULL, is_ft8, base_freq, tmp, sec) < 0 ? -1 : 0;
 
-  monitor_free(&mon);
+  ft8_decoder_t *dec = decoder_get(sample_rate, is_ft8);
+  if(dec == NULL)
+    return -1;
+
+  for (int frame_pos = 0; frame_pos + dec->mon.block_size <= num_samples; frame_pos += dec->mon.block_size)
+    {
+      // Process the waveform data frame by frame - you could have a live loop here with data from an audio device
+      // (cool, now that we can get sample timings - KA9Q)
+      decoder_feed(dec, signal + frame_pos, dec->mon.block_size);
+    }
+  decoder_decode(dec);
+  decoder_print(dec, base_freq, tmp, sec);
   return 0; // Caller frees signal
 }
+
+// Process a WAV file one block at a time, straight from its mapping, so the slot is never held as floats
+// Aligned samples (the usual case) go to the STFT in place, 16-bit ones without conversion
+int process_wav(wav_reader_t *wav, bool is_ft8, float base_freq, struct tm const *tmp, double sec){
+  assert(wav != NULL && tmp != NULL);
+
+  LOG(LOG_INFO, "Sample rate %d Hz, %d samples, %.3f seconds\n", wav->sample_rate, wav->num_frames, (double)wav->num_frames / wav->sample_rate);
+
+  if(Num_ddc_bands > 0)
+    return process_bands(NULL, 0, wav->sample_rate, wav, is_ft8, base_freq, tmp, sec) < 0 ? -1 : 0;
+
+  ft8_decoder_t *dec = decoder_get(wav->sample_rate, is_ft8);
+  if(dec == NULL)
+    return -1;
+  int const block_size = dec->mon.block_size;
+  // Whole blocks only, like process_buffer()
+  if(wav->aligned){
+    void const *samples;
+    while(!decoder_full(dec) && wav_next(wav, block_size, &samples) == block_size){
+      if(wav->audio_format == 1)
+	decoder_feed_s16(dec, samples, block_size);
+      else
+	decoder_feed(dec, samples, block_size);
+    }
+  } else {
+    float *block = malloc(sizeof(float) * block_size);
+    if(block == NULL)
+      return -1;
+    while(!decoder_full(dec) && wav_read(wav, block, block_size) == block_size)
+      decoder_feed(dec, block, block_size);
+    free(block);
+  }
+  decoder_decode(dec);
+  decoder_print(dec, base_freq, tmp, sec);
+  return 0;
+}
+
+// One sub-band of a wideband capture, down-converted and decoded with a decoder of its own
+struct band_job {
+  ddc_channel_t chan;
+  ft8_decoder_t dec;
+  bool ok;              // Set up; chan and dec are valid
+};
+
+static void *band_decode(void *arg){
+  struct band_job *job = arg;
+  decoder_decode(&job->dec);
+  return NULL;
+}
+
+int process_bands(float const *signal, int num_samples, int sample_rate, wav_reader_t const *wav, bool is_ft8, double base_freq, struct tm const *tmp, double sec){
+  assert(signal != NULL || wav != NULL);
+  ddc_t ddc;
+  if(!ddc_init(&ddc, sample_rate, DDC_RATE, Rfft_default_backend)){
+    fprintf(stderr,"Can't down-convert from %d Hz to %d Hz\n",sample_rate,DDC_RATE);
+    return -1;
+  }
+  struct band_job *jobs = calloc(Num_ddc_bands, sizeof *jobs);
+  float *out = malloc(ddc.out_nfft / 2 * sizeof *out);
+  if(jobs == NULL || out == NULL){
+    free(jobs);
+    free(out);
+    ddc_free(&ddc);
+    return -1;
+  }
+  int ok = 0;
+  for(int i = 0; i < Num_ddc_bands; i++){
+    band_t const *band = &Ddc_bands[i];
+    if(!ddc_channel_init(&jobs[i].chan, &ddc, band->low, band->high)){
+      fprintf(stderr,"Can't down-convert %.0f-%.0f Hz from %d Hz\n",band->low,band->high,sample_rate);
+      continue;
+    }
+    // Analyse just the band, where it lands at the lower rate
+    float const shift = jobs[i].chan.shift;
+    if(!decoder_init_band(&jobs[i].dec, DDC_RATE, is_ft8, band->low - shift, band->high - shift)){
+      ddc_channel_free(&jobs[i].chan);
+      continue;
+    }
+    jobs[i].ok = true;
+    ok++;
+  }
+  // The forward FFT is shared, so the front end runs here; the bands then decode on parallel threads.
+  // Half a block of silence after the input flushes out the last of it
+  wav_reader_t reader;
+  if(signal == NULL)
+    reader = *wav; // A copy sharing the caller's mapping, so the caller's stays where it was
+  float in[4096];
+  int pos = 0, tail = ddc.nfft / 2;
+  bool full = (ok == 0);
+  while(!full){
+    int n;
+    if(signal != NULL){
+      n = num_samples - pos < (int)(sizeof in / sizeof in[0]) ? num_samples - pos : (int)(sizeof in / sizeof in[0]);
+      memcpy(in, signal + pos, n * sizeof in[0]);
+      pos += n;
+    } else
+      n = wav_read(&reader, in, sizeof in / sizeof in[0]);
+    if(n <= 0){
+      if(tail <= 0)
+        break;
+      n = tail < (int)(sizeof in / sizeof in[0]) ? tail : (int)(sizeof in / sizeof in[0]);
+      memset(in, 0, n * sizeof in[0]);
+      tail -= n;
+    }
+    for(int done = 0; done < n && !full;){
+      done += ddc_push(&ddc, in + done, n - done);
+      if(!ddc_ready(&ddc))
+        continue;
+      ddc_compute(&ddc);
+      full = true;
+      for(int i = 0; i < Num_ddc_bands; i++){
+        if(!jobs[i].ok || decoder_full(&jobs[i].dec))
+          continue;
+        int const count = ddc_channel_output(&jobs[i].chan, &ddc, out);
+        decoder_feed(&jobs[i].dec, out, count);
+        full = full && decoder_full(&jobs[i].dec);
+      }
+    }
+  }
+  // One thread per band besides the caller's, which takes the first
+  pthread_t tids[Num_ddc_bands];
+  bool started[Num_ddc_bands];
+  int first = -1;
+  for(int i = 0; i < Num_ddc_bands; i++){
+    started[i] = false;
+    if(!jobs[i].ok)
+      continue;
+    if(first < 0)
+      first = i;
+    else
+      started[i] = pthread_create(&tids[i], NULL, band_decode, &jobs[i]) == 0;
+  }
+  for(int i = 0; i < Num_ddc_bands; i++){
+    if(!jobs[i].ok)
+      continue;
+    if(started[i])
+      pthread_join(tids[i], NULL);
+    else
+      band_decode(&jobs[i]); // The first, or one a thread couldn't be started for
+  }
+  // Print in band order; each band's frequencies are shifted back to where they were in the capture
+  int total = 0;
+  for(int i = 0; i < Num_ddc_bands; i++){
+    if(!jobs[i].ok)
+      continue;
+    total += jobs[i].dec.num_decoded;
+    if(tmp != NULL)
+      decoder_print(&jobs[i].dec, base_freq + 1e-6 * jobs[i].chan.shift, tmp, sec);
+    decoder_free(&jobs[i].dec);
+    ddc_channel_free(&jobs[i].chan);
+  }
+  free(out);
+  free(jobs);
+  ddc_free(&ddc);
+  return ok > 0 ? total : -1;
+}
@@ -0,0 +1,176 @@
+#ifndef _INCLUDE_DECODE_FT8_H_
+#define _INCLUDE_DECODE_FT8_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ft8/decode.h"
+#include "common/stft.h"
+#include "common/mag_db.h"
+#include "common/wave.h"
+#include "common/ddc.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Configuration options for FT4/FT8 monitor
+typedef struct
+{
+    float f_min;             ///< Lower frequency bound for analysis (Hz)
+    float f_max;             ///< Upper frequency bound for analysis (Hz); 0 for everything up to Nyquist
+    int sample_rate;         ///< Sample rate in Hertz
+    int time_osr;            ///< Number of time subdivisions
+    int freq_osr;            ///< Number of frequency subdivisions
+    ftx_protocol_t protocol; ///< Protocol: FT4 or FT8
+    rfft_backend_t fft_backend; ///< FFT implementation (RFFT_NUM_BACKENDS for the default)
+} monitor_config_t;
+
+/// FT4/FT8 monitor object that manages DSP processing of incoming audio data
+/// and prepares a waterfall object
+typedef struct
+{
+    float symbol_period; ///< FT4/FT8 symbol period in seconds
+    int block_size;      ///< Number of samples per symbol (block)
+    int subblock_size;   ///< Analysis shift size (number of samples)
+    int nfft;            ///< FFT size
+    float fft_norm;      ///< FFT normalization factor
+    stft_t stft;         ///< Streaming STFT analysis (window, input history and FFT)
+    int time_sub;        ///< Time subdivision the next STFT frame belongs to
+    waterfall_t wf;      ///< Waterfall object
+    float max_mag;       ///< Maximum detected magnitude (debug stats)
+    mag_db_fn mag_db;    ///< Power to waterfall magnitude conversion (SIMD when available)
+} monitor_t;
+
+/// Returns false if the STFT or waterfall could not be allocated
+bool monitor_init(monitor_t* me, const monitor_config_t* cfg);
+void monitor_free(monitor_t* me);
+void monitor_reset(monitor_t* me);
+/// Feed any number of samples; returns the number consumed (less than n only when the waterfall is full)
+int monitor_feed(monitor_t* me, const float* samples, int n);
+/// Feed exactly one block (time_osr * subblock_size samples)
+void monitor_process(monitor_t* me, const float* frame);
+/// The same for 16-bit samples, taken without conversion (full scale is 32768).
+/// Don't mix the two formats within one waterfall
+int monitor_feed_s16(monitor_t* me, const int16_t* samples, int n);
+void monitor_process_s16(monitor_t* me, const int16_t* frame);
+
+/// Decoder for one slot at a time: the monitor plus every distinct message decoded from it so far.
+/// The waterfall can be decoded any number of times while it fills; each pass merges its
+/// messages into the slot's duplicate table, and decoder_print() reports only the new ones.
+typedef struct
+{
+    monitor_config_t cfg;           ///< Monitor configuration
+    monitor_t mon;                  ///< Waterfall being filled
+    int candidate_size;             ///< Maximum number of sync candidates per pass
+    candidate_t* candidates;        ///< Sync candidates of the current pass
+    message_t* messages;            ///< Per-candidate results of the current pass
+    bool* valid;                    ///< valid[i] set when messages[i] holds a decode
+    int* ldpc_errors;               ///< BP parity errors left on each candidate of the current pass
+    int* picked;                    ///< Candidates picked for the current decoding wave or for OSD
+    int osd_used;                   ///< OSD attempts spent so far in this slot
+    int num_sync;                   ///< Sync candidates found so far in this slot, over all passes
+    int ldpc_runs;                  ///< Of those, the ones given to the LDPC decoder
+    int ldpc_skipped;               ///< and the ones skipped beside an already decoded signal
+    int num_payloads;               ///< Successful decodes so far in this slot, duplicates included
+    int num_unpacked;               ///< Of those, the new payloads that were unpacked in plain text
+    message_t* decoded;             ///< Messages decoded in this slot, stored by hash (kMax_decoded_messages)
+    message_t** decoded_hashtable;  ///< Occupied entries of decoded[], NULL when free
+    bool* printed;                  ///< printed[i] set once decoded[i] has been reported
+    int num_decoded;                ///< Number of distinct messages decoded in this slot
+    bool* subtracted;               ///< subtracted[i] set once decoded[i] has been subtracted from the audio
+    float* audio;                   ///< The slot's samples, kept for multi-pass decoding (NULL with one pass)
+    int audio_len;                  ///< Samples in audio
+    int audio_size;                 ///< Room in audio: one whole waterfall
+} ft8_decoder_t;
+
+/// Allocate a decoder for the given sample rate and protocol; returns false on failure
+bool decoder_init(ft8_decoder_t* me, int sample_rate, bool is_ft8);
+/// The same, analysing only f_min .. f_max Hz (decoder_init() takes the band from Freq_min and Freq_max)
+bool decoder_init_band(ft8_decoder_t* me, int sample_rate, bool is_ft8, float f_min, float f_max);
+void decoder_free(ft8_decoder_t* me);
+/// Start a new slot: empty the waterfall and forget the messages already decoded
+void decoder_reset(ft8_decoder_t* me);
+/// A decoder for the sample rate and protocol, already reset, from the calling thread's cache.
+/// It's set up on first use and reused by later calls with the same parameters, so decoding file
+/// after file costs no allocation or window/FFT setup. Don't free it; it stays valid until this
+/// thread's next decoder_get() or decoder_cache_free(). Returns NULL on failure
+ft8_decoder_t* decoder_get(int sample_rate, bool is_ft8);
+/// Free the calling thread's cached decoders
+void decoder_cache_free(void);
+/// Add samples to the waterfall; returns the number consumed (less than n once the slot is full)
+int decoder_feed(ft8_decoder_t* me, const float* samples, int n);
+/// The same for 16-bit samples
+int decoder_feed_s16(ft8_decoder_t* me, const int16_t* samples, int n);
+/// Seconds of signal currently in the waterfall
+float decoder_seconds(const ft8_decoder_t* me);
+/// True when the waterfall holds a whole slot
+bool decoder_full(const ft8_decoder_t* me);
+/// Search the waterfall as it stands and decode; returns the number of new messages
+int decoder_decode(ft8_decoder_t* me);
+/// Print the messages not yet reported, sorted by frequency
+/// base_freq = radio frequency in MHz corresponding to zero frequency here (receiver is always USB)
+/// tmp = UTC @ signal[0], sec = fractional second in UTC @ signal[0]
+int decoder_print(ft8_decoder_t* me, double base_freq, struct tm const* tmp, double sec);
+
+// base_freq = radio frequency in Hz corresponding to zero frequency here (receiver is always USB)
+// tmp = UTC @ signal[0]
+// fsec = fractional second in UTC @ signal[0]
+int process_buffer(float const *signal,int sample_rate, int num_samples, bool is_ft8, float base_freq, struct tm const *tmp, double fsec);
+
+// Same, reading the samples a block at a time from a WAV file opened with wav_open()
+int process_wav(wav_reader_t *wav, bool is_ft8, float base_freq, struct tm const *tmp, double fsec);
+
+// Both hand the slot to process_bands() when sub-bands are set in Ddc_bands. It down-converts each band to
+// 12 kHz through one filter bank (common/ddc.h), decodes it with its own decoder, the bands on parallel threads, then prints them
+// in band order if tmp isn't NULL. Samples come from signal (num_samples at sample_rate) or, if that's NULL,
+// from wav, which is left where it was. Returns the messages decoded over all bands, -1 if no band could be set up
+int process_bands(float const *signal, int num_samples, int sample_rate, wav_reader_t const *wav, bool is_ft8, double base_freq, struct tm const *tmp, double fsec);
+
+// Number of threads used for the sync search and to decode sync candidates (default 1)
+extern int Decode_threads;
+
+// ft8_find_sync() on up to 'threads' threads, including the caller's: the search is split with ft8_sync_split(),
+// the parts searched concurrently and merged into exactly the list ft8_find_sync() returns
+int find_sync_parallel(waterfall_t const *wf, int num_candidates, candidate_t heap[], int min_score, int threads);
+
+// Use ft8_find_sync_coarse() rather than the exhaustive search (default false)
+extern bool Coarse_sync;
+
+// Use ldpc_decode_layered() rather than bp_decode_batch() (default false)
+extern bool Ldpc_layered;
+
+// Ordered statistics decoding depth for BP near misses (0 = off, the default; 1 or 2)
+// and the most OSD attempts per slot (default 100)
+extern int Osd_depth;
+extern int Osd_budget;
+
+// Decoding passes per slot (default 1). Each later pass subtracts the signals decoded so far
+// from the audio, recomputes the waterfall where they were and searches it again
+extern int Decode_passes;
+
+// Print each slot's sync candidate and LDPC decode counts on stderr (default false)
+extern bool Decode_stats;
+
+// Audio band to analyse, in Hz (default 0 and 0: the whole band). Only signals lying wholly inside are
+// decoded; the waterfall, sync search and candidate count shrink in proportion
+extern float Freq_min;
+extern float Freq_max;
+
+// Sub-bands (Hz) of a wideband capture to decode through the down-converter instead of analysing the
+// whole capture at its own rate (default none). Each is at most 5.6 kHz wide; they shouldn't overlap
+#define MAX_DDC_BANDS (16)
+typedef struct
+{
+    float low, high;
+} band_t;
+extern band_t Ddc_bands[MAX_DDC_BANDS];
+extern int Num_ddc_bands;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_DECODE_FT8_H_
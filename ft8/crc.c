@@ -3,37 +3,77 @@
 
 #define TOPBIT (1u << (FT8_CRC_WIDTH - 1))
 
+// Remainder of each byte value in the top 8 bits of the register after 8 division steps
+static const uint16_t kCRC_table[256] = {
+    0x0000, 0x2757, 0x29f9, 0x0eae, 0x34a5, 0x13f2, 0x1d5c, 0x3a0b,
+    0x0e1d, 0x294a, 0x27e4, 0x00b3, 0x3ab8, 0x1def, 0x1341, 0x3416,
+    0x1c3a, 0x3b6d, 0x35c3, 0x1294, 0x289f, 0x0fc8, 0x0166, 0x2631,
+    0x1227, 0x3570, 0x3bde, 0x1c89, 0x2682, 0x01d5, 0x0f7b, 0x282c,
+    0x3874, 0x1f23, 0x118d, 0x36da, 0x0cd1, 0x2b86, 0x2528, 0x027f,
+    0x3669, 0x113e, 0x1f90, 0x38c7, 0x02cc, 0x259b, 0x2b35, 0x0c62,
+    0x244e, 0x0319, 0x0db7, 0x2ae0, 0x10eb, 0x37bc, 0x3912, 0x1e45,
+    0x2a53, 0x0d04, 0x03aa, 0x24fd, 0x1ef6, 0x39a1, 0x370f, 0x1058,
+    0x17bf, 0x30e8, 0x3e46, 0x1911, 0x231a, 0x044d, 0x0ae3, 0x2db4,
+    0x19a2, 0x3ef5, 0x305b, 0x170c, 0x2d07, 0x0a50, 0x04fe, 0x23a9,
+    0x0b85, 0x2cd2, 0x227c, 0x052b, 0x3f20, 0x1877, 0x16d9, 0x318e,
+    0x0598, 0x22cf, 0x2c61, 0x0b36, 0x313d, 0x166a, 0x18c4, 0x3f93,
+    0x2fcb, 0x089c, 0x0632, 0x2165, 0x1b6e, 0x3c39, 0x3297, 0x15c0,
+    0x21d6, 0x0681, 0x082f, 0x2f78, 0x1573, 0x3224, 0x3c8a, 0x1bdd,
+    0x33f1, 0x14a6, 0x1a08, 0x3d5f, 0x0754, 0x2003, 0x2ead, 0x09fa,
+    0x3dec, 0x1abb, 0x1415, 0x3342, 0x0949, 0x2e1e, 0x20b0, 0x07e7,
+    0x2f7e, 0x0829, 0x0687, 0x21d0, 0x1bdb, 0x3c8c, 0x3222, 0x1575,
+    0x2163, 0x0634, 0x089a, 0x2fcd, 0x15c6, 0x3291, 0x3c3f, 0x1b68,
+    0x3344, 0x1413, 0x1abd, 0x3dea, 0x07e1, 0x20b6, 0x2e18, 0x094f,
+    0x3d59, 0x1a0e, 0x14a0, 0x33f7, 0x09fc, 0x2eab, 0x2005, 0x0752,
+    0x170a, 0x305d, 0x3ef3, 0x19a4, 0x23af, 0x04f8, 0x0a56, 0x2d01,
+    0x1917, 0x3e40, 0x30ee, 0x17b9, 0x2db2, 0x0ae5, 0x044b, 0x231c,
+    0x0b30, 0x2c67, 0x22c9, 0x059e, 0x3f95, 0x18c2, 0x166c, 0x313b,
+    0x052d, 0x227a, 0x2cd4, 0x0b83, 0x3188, 0x16df, 0x1871, 0x3f26,
+    0x38c1, 0x1f96, 0x1138, 0x366f, 0x0c64, 0x2b33, 0x259d, 0x02ca,
+    0x36dc, 0x118b, 0x1f25, 0x3872, 0x0279, 0x252e, 0x2b80, 0x0cd7,
+    0x24fb, 0x03ac, 0x0d02, 0x2a55, 0x105e, 0x3709, 0x39a7, 0x1ef0,
+    0x2ae6, 0x0db1, 0x031f, 0x2448, 0x1e43, 0x3914, 0x37ba, 0x10ed,
+    0x00b5, 0x27e2, 0x294c, 0x0e1b, 0x3410, 0x1347, 0x1de9, 0x3abe,
+    0x0ea8, 0x29ff, 0x2751, 0x0006, 0x3a0d, 0x1d5a, 0x13f4, 0x34a3,
+    0x1c8f, 0x3bd8, 0x3576, 0x1221, 0x282a, 0x0f7d, 0x01d3, 0x2684,
+    0x1292, 0x35c5, 0x3b6b, 0x1c3c, 0x2637, 0x0160, 0x0fce, 0x2899,
+};
+
 // Compute 14-bit CRC for a sequence of given number of bits
 // Adapted from https://barrgroup.com/Embedded-Systems/How-To/CRC-Calculation-C-Code
+// Whole bytes go through kCRC_table, a byte per step; the bits of a final partial byte one at a time
 // [IN] message  - byte sequence (MSB first)
 // [IN] num_bits - number of bits in the sequence
 uint16_t ftx_compute_crc(const uint8_t message[], int num_bits)
 {
+    const uint16_t mask = (TOPBIT << 1) - 1u;
     uint16_t remainder = 0;
     int idx_byte = 0;
 
-    // Perform modulo-2 division, a bit at a time.
-    for (int idx_bit = 0; idx_bit < num_bits; ++idx_bit)
+    for (; idx_byte < num_bits / 8; ++idx_byte)
     {
-        if (idx_bit % 8 == 0)
-        {
-            // Bring the next byte into the remainder.
-            remainder ^= (message[idx_byte] << (FT8_CRC_WIDTH - 8));
-            ++idx_byte;
-        }
+        const uint8_t top = (uint8_t)((remainder >> (FT8_CRC_WIDTH - 8)) ^ message[idx_byte]);
+        remainder = ((remainder << 8) ^ kCRC_table[top]) & mask;
+    }
 
-        // Try to divide the current data bit.
-        if (remainder & TOPBIT)
-        {
-            remainder = (remainder << 1) ^ FT8_CRC_POLYNOMIAL;
-        }
-        else
+    if (num_bits % 8 != 0)
+    {
+        // Bring the last byte into the remainder and divide just its leading bits
+        remainder ^= (message[idx_byte] << (FT8_CRC_WIDTH - 8));
+        for (int idx_bit = 0; idx_bit < num_bits % 8; ++idx_bit)
         {
-            remainder = (remainder << 1);
+            if (remainder & TOPBIT)
+            {
+                remainder = (remainder << 1) ^ FT8_CRC_POLYNOMIAL;
+            }
+            else
+            {
+                remainder = (remainder << 1);
+            }
         }
     }
 
-    return remainder & ((TOPBIT << 1) - 1u);
+    return remainder & mask;
 }
 
 uint16_t ftx_extract_crc(const uint8_t a91[])
@@ -5,32 +5,16 @@
 #include "unpack.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
-/// Compute log likelihood log(p(1) / p(0)) of 174 message bits for later use in soft-decision LDPC decoding
-/// @param[in] wf Waterfall data collected during message slot
-/// @param[in] cand Candidate to extract the message from
-/// @param[in] code_map Symbol encoding map
-/// @param[out] log174 Output of decoded log likelihoods for each of the 174 message bits
-static void ft4_extract_likelihood(const waterfall_t* wf, const candidate_t* cand, float* log174);
-static void ft8_extract_likelihood(const waterfall_t* wf, const candidate_t* cand, float* log174);
-
-/// Packs a string of bits each represented as a zero/non-zero byte in bit_array[],
-/// as a string of packed bits starting from the MSB of the first byte of packed[]
-/// @param[in] plain Array of bits (0 and nonzero values) with num_bits entires
-/// @param[in] num_bits Number of bits (entries) passed in bit_array
-/// @param[out] packed Byte-packed bits representing the data in bit_array
-static void pack_bits(const uint8_t bit_array[], int num_bits, uint8_t packed[]);
-
-static float max2(float a, float b);
-static float max4(float a, float b, float c, float d);
 static void heapify_down(candidate_t heap[], int heap_size);
 static void heapify_up(candidate_t heap[], int heap_size);
+static void heap_push(candidate_t heap[], int* heap_size, int num_candidates, const candidate_t* candidate);
+static void heap_sort(candidate_t heap[], int heap_size);
+static int sync_symbols(ftx_protocol_t protocol, int blocks[], int tones[]);
 
-static void ftx_normalize_logl(float* log174);
-static void ft4_extract_symbol(const uint8_t* wf, float* logl);
-static void ft8_extract_symbol(const uint8_t* wf, float* logl);
-static void ft8_decode_multi_symbols(const uint8_t* wf, int num_bins, int n_syms, int bit_idx, float* log174);
 
 static int get_index(const waterfall_t* wf, const candidate_t* candidate)
 {
@@ -170,7 +154,8 @@ static int ft4_sync_score(const waterfall_t* wf, const candidate_t* candidate)
     return score;
 }
 
-int ft8_find_sync(const waterfall_t* wf, int num_candidates, candidate_t heap[], int min_score)
+/// Sync search scoring every candidate separately with ft8_sync_score()/ft4_sync_score()
+static int find_sync_direct(const waterfall_t* wf, int num_candidates, candidate_t heap[], int min_score)
 {
     int heap_size = 0;
     candidate_t candidate;
@@ -198,147 +183,574 @@ int ft8_find_sync(const waterfall_t* wf, int num_candidates, candidate_t heap[],
                     if (candidate.score < min_score)
                         continue;
 
-                    // If the heap is full AND the current candidate is better than
-                    // the worst in the heap, we remove the worst and make space
-                    if (heap_size == num_candidates && candidate.score > heap[0].score)
-                    {
-                        heap[0] = heap[heap_size - 1];
-                        --heap_size;
-                        heapify_down(heap, heap_size);
-                    }
-
-                    // If there's free space in the heap, we add the current candidate
-                    if (heap_size < num_candidates)
-                    {
-                        heap[heap_size] = candidate;
-                        ++heap_size;
-                        heapify_up(heap, heap_size);
-                    }
+                    heap_push(heap, &heap_size, num_candidates, &candidate);
                 }
             }
         }
     }
 
-    // Sort the candidates by sync strength - here we benefit from the heap structure
-    int len_unsorted = heap_size;
-    while (len_unsorted > 1)
+    heap_sort(heap, heap_size);
+    return heap_size;
+}
+
+/// sum[i] += row[i] for i < n; kept simple so the compiler vectorizes it
+static void add_row(int16_t* restrict sum, const int16_t* restrict row, int n)
+{
+    for (int i = 0; i < n; ++i)
+        sum[i] += row[i];
+}
+
+/// Note a candidate that got into a part's private heap
+static bool part_record(ft8_sync_part_t* part, const candidate_t* candidate, int order, int* capacity)
+{
+    if (part->num_found == *capacity)
     {
-        candidate_t tmp = heap[len_unsorted - 1];
-        heap[len_unsorted - 1] = heap[0];
-        heap[0] = tmp;
-        len_unsorted--;
-        heapify_down(heap, len_unsorted);
+        const int size = (*capacity > 0) ? 2 * *capacity : 256;
+        candidate_t* found = realloc(part->found, sizeof(candidate_t) * size);
+        if (found != NULL)
+            part->found = found;
+        int* orders = realloc(part->order, sizeof(int) * size);
+        if (orders != NULL)
+            part->order = orders;
+        if (found == NULL || orders == NULL)
+            return false;
+        *capacity = size;
+    }
+    part->found[part->num_found] = *candidate;
+    part->order[part->num_found] = order;
+    ++part->num_found;
+    return true;
+}
+
+/// The exhaustive sync search over subdivisions [sub_begin, sub_end) and frequency offsets [freq_begin, freq_end),
+/// adding to the heap. When part is given, every candidate that gets into the heap is also listed there.
+/// @return false if memory could not be allocated
+static bool find_sync_range(const waterfall_t* wf, int num_candidates, candidate_t heap[], int* heap_size, int min_score,
+                            int sub_begin, int sub_end, int freq_begin, int freq_end, ft8_sync_part_t* part)
+{
+    // Every term of the sync score is the difference between the expected tone's cell and one of its neighbours
+    // (one bin lower/higher, one symbol earlier/later), and each cell is visited by dozens of overlapping candidates.
+    // So for each time/frequency subdivision the differences are computed once as planes, after which the scores
+    // of all frequency offsets at one time offset are a few row additions. The terms and their count are exactly
+    // those of ft8_sync_score()/ft4_sync_score(), and candidates reach the heap in the same order, so the result
+    // is identical to scoring each candidate separately. Sums of up to 84 differences of uint8_t fit in int16_t.
+    // The planes cover just the bins the range of frequency offsets looks at.
+    const int num_freqs = freq_end - freq_begin;
+    const int num_blocks = wf->num_blocks;
+    const int num_bins = wf->num_bins;
+    const int width = num_freqs + 7;
+    const int plane_size = num_blocks * width;
+    int16_t* planes = malloc(sizeof(int16_t) * 6 * plane_size);
+    int16_t* sum = malloc(sizeof(int16_t) * num_freqs);
+    if (planes == NULL || sum == NULL)
+    {
+        free(planes);
+        free(sum);
+        return false;
+    }
+    int16_t* d_lo = planes;                   // p[bin] - p[bin - 1]
+    int16_t* d_hi = planes + plane_size;      // p[bin] - p[bin + 1]
+    int16_t* d_lohi = planes + 2 * plane_size; // both
+    int16_t* d_back = planes + 3 * plane_size; // p[block][bin] - p[block - 1][bin]
+    int16_t* d_fwd = planes + 4 * plane_size;  // p[block][bin] - p[block + 1][bin]
+    int16_t* d_backfwd = planes + 5 * plane_size;
+
+    int sync_blocks[FT8_NUM_SYNC * FT8_LENGTH_SYNC];
+    int sync_tones[FT8_NUM_SYNC * FT8_LENGTH_SYNC];
+    const int num_sync = sync_symbols(wf->protocol, sync_blocks, sync_tones);
+    const int length_sync = (wf->protocol == PROTO_FT4) ? FT4_LENGTH_SYNC : FT8_LENGTH_SYNC;
+    const int max_tone = (wf->protocol == PROTO_FT4) ? 3 : 7;
+    const int all_freqs = num_bins - 7;
+    int capacity = 0;
+    bool ok = true;
+    candidate_t candidate;
+
+    for (int sub = sub_begin; sub < sub_end && ok; ++sub)
+    {
+        candidate.time_sub = sub / wf->freq_osr;
+        candidate.freq_sub = sub % wf->freq_osr;
+        const uint8_t* mag = wf->mag + sub * num_bins;
+        for (int block = 0; block < num_blocks; ++block)
+        {
+            const uint8_t* p = mag + block * wf->block_stride;
+            const uint8_t* prev = (block > 0) ? p - wf->block_stride : p;
+            const uint8_t* next = (block + 1 < num_blocks) ? p + wf->block_stride : p;
+            int16_t* lo = d_lo + block * width - freq_begin; // Indexed by bin
+            int16_t* hi = d_hi + block * width - freq_begin;
+            int16_t* lohi = d_lohi + block * width - freq_begin;
+            int16_t* back = d_back + block * width - freq_begin;
+            int16_t* fwd = d_fwd + block * width - freq_begin;
+            int16_t* backfwd = d_backfwd + block * width - freq_begin;
+            const int bin_end = freq_begin + width;
+
+            // The lower neighbour of bin 0 and the upper one of the last bin are never used
+            for (int bin = freq_begin; bin < bin_end; ++bin)
+                lo[bin] = (bin > 0) ? p[bin] - p[bin - 1] : 0;
+            for (int bin = freq_begin; bin < bin_end; ++bin)
+                hi[bin] = (bin + 1 < num_bins) ? p[bin] - p[bin + 1] : 0;
+            for (int bin = freq_begin; bin < bin_end; ++bin)
+            {
+                lohi[bin] = lo[bin] + hi[bin];
+                back[bin] = p[bin] - prev[bin]; // All zero for the first and last block,
+                fwd[bin] = p[bin] - next[bin];  // where those terms don't exist
+                backfwd[bin] = back[bin] + fwd[bin];
+            }
+        }
+
+        for (candidate.time_offset = -12; candidate.time_offset < 24 && ok; ++candidate.time_offset)
+        {
+            memset(sum, 0, sizeof(int16_t) * num_freqs);
+            int num_average = 0;
+            for (int s = 0; s < num_sync; ++s)
+            {
+                const int block_abs = candidate.time_offset + sync_blocks[s];
+                if (block_abs < 0 || block_abs >= num_blocks)
+                    continue;
+                const int k = s % length_sync;
+                const int sm = sync_tones[s];
+                const bool has_lo = (sm > 0);
+                const bool has_hi = (sm < max_tone);
+                const bool has_back = (k > 0) && (block_abs > 0);
+                const bool has_fwd = ((k + 1) < length_sync) && ((block_abs + 1) < num_blocks);
+                num_average += has_lo + has_hi + has_back + has_fwd;
+
+                const int offset = block_abs * width + sm;
+                add_row(sum, ((has_lo && has_hi) ? d_lohi : has_lo ? d_lo : d_hi) + offset, num_freqs);
+                if (has_back || has_fwd)
+                    add_row(sum, ((has_back && has_fwd) ? d_backfwd : has_back ? d_back : d_fwd) + offset, num_freqs);
+            }
+
+            // Position of the first of these candidates in the order of the whole search
+            const int order = (sub * 36 + candidate.time_offset + 12) * all_freqs + freq_begin;
+            for (int i = 0; i < num_freqs; ++i)
+            {
+                int score = sum[i];
+                if (num_average > 0)
+                    score /= num_average;
+                candidate.score = score;
+                if (candidate.score < min_score)
+                    continue;
+
+                candidate.freq_offset = freq_begin + i;
+                if (part != NULL && (*heap_size < num_candidates || candidate.score > heap[0].score))
+                    ok = part_record(part, &candidate, order + i, &capacity);
+                heap_push(heap, heap_size, num_candidates, &candidate);
+            }
+        }
     }
+    free(planes);
+    free(sum);
+    return ok;
+}
+
+int ft8_find_sync(const waterfall_t* wf, int num_candidates, candidate_t heap[], int min_score)
+{
+    const int num_freqs = wf->num_bins - 7; // Same freq_offset range as before
+    int heap_size = 0;
+    if (num_freqs <= 0 || wf->num_blocks <= 0
+        || !find_sync_range(wf, num_candidates, heap, &heap_size, min_score, 0, wf->time_osr * wf->freq_osr, 0, num_freqs, NULL))
+        return find_sync_direct(wf, num_candidates, heap, min_score);
 
+    heap_sort(heap, heap_size);
     return heap_size;
 }
 
-static void ft4_extract_likelihood(const waterfall_t* wf, const candidate_t* cand, float* log174)
+int ft8_sync_split(const waterfall_t* wf, int max_parts, ft8_sync_part_t parts[])
 {
-    const uint8_t* mag_cand = wf->mag + get_index(wf, cand);
+    const int num_subs = wf->time_osr * wf->freq_osr;
+    const int num_freqs = wf->num_bins - 7;
+    if (max_parts < 1 || num_freqs <= 0)
+        return 0;
+    // Subdivisions share out with no overlap at all; frequency ranges each recompute 7 bins of their neighbour's
+    const bool by_sub = (max_parts <= num_subs) && (num_subs % max_parts == 0);
+    const int num_parts = by_sub ? max_parts : ((max_parts < num_freqs) ? max_parts : num_freqs);
+    for (int i = 0; i < num_parts; ++i)
+    {
+        memset(&parts[i], 0, sizeof(parts[i]));
+        parts[i].sub_begin = by_sub ? i * num_subs / num_parts : 0;
+        parts[i].sub_end = by_sub ? (i + 1) * num_subs / num_parts : num_subs;
+        parts[i].freq_begin = by_sub ? 0 : i * num_freqs / num_parts;
+        parts[i].freq_end = by_sub ? num_freqs : (i + 1) * num_freqs / num_parts;
+    }
+    return num_parts;
+}
+
+bool ft8_find_sync_part(const waterfall_t* wf, int num_candidates, int min_score, ft8_sync_part_t* part)
+{
+    part->found = NULL;
+    part->order = NULL;
+    part->num_found = 0;
+    if (part->freq_begin >= part->freq_end || part->sub_begin >= part->sub_end || wf->num_blocks <= 0)
+        return true;
+    candidate_t* heap = malloc(sizeof(candidate_t) * num_candidates);
+    int heap_size = 0;
+    bool ok = (heap != NULL)
+        && find_sync_range(wf, num_candidates, heap, &heap_size, min_score, part->sub_begin, part->sub_end,
+                           part->freq_begin, part->freq_end, part);
+    free(heap);
+    return ok;
+}
 
-    // Go over FSK tones and skip Costas sync symbols
-    for (int k = 0; k < FT4_ND; ++k)
+int ft8_find_sync_merge(int num_candidates, candidate_t heap[], ft8_sync_part_t parts[], int num_parts)
+{
+    // A candidate turned away by its part's heap would have been turned away by the shared one too: that heap's
+    // weakest member is at least as strong, having seen everything the part's had and more. So replaying the
+    // parts' lists in search order pushes exactly the candidates a search on one thread would, in the same order
+    int heap_size = 0;
+    int next[num_parts > 0 ? num_parts : 1];
+    memset(next, 0, sizeof(next));
+    while (true)
+    {
+        int best = -1;
+        for (int i = 0; i < num_parts; ++i)
+        {
+            if (next[i] < parts[i].num_found && (best < 0 || parts[i].order[next[i]] < parts[best].order[next[best]]))
+                best = i;
+        }
+        if (best < 0)
+            break;
+        heap_push(heap, &heap_size, num_candidates, &parts[best].found[next[best]]);
+        ++next[best];
+    }
+    for (int i = 0; i < num_parts; ++i)
     {
-        // Skip either 5, 9 or 13 sync symbols
-        // TODO: replace magic numbers with constants
-        int sym_idx = k + ((k < 29) ? 5 : ((k < 58) ? 9 : 13));
-        int bit_idx = 2 * k;
+        free(parts[i].found);
+        free(parts[i].order);
+        parts[i].found = NULL;
+        parts[i].order = NULL;
+        parts[i].num_found = 0;
+    }
 
-        // Check for time boundaries
-        int block = cand->time_offset + sym_idx;
-        if ((block < 0) || (block >= wf->num_blocks))
+    heap_sort(heap, heap_size);
+    return heap_size;
+}
+
+/// Positions (block relative to the message start) and tones of the sync symbols
+static int sync_symbols(ftx_protocol_t protocol, int blocks[], int tones[])
+{
+    int n = 0;
+    if (protocol == PROTO_FT4)
+    {
+        for (int m = 0; m < FT4_NUM_SYNC; ++m)
         {
-            log174[bit_idx + 0] = 0;
-            log174[bit_idx + 1] = 0;
+            for (int k = 0; k < FT4_LENGTH_SYNC; ++k)
+            {
+                blocks[n] = 1 + (FT4_SYNC_OFFSET * m) + k;
+                tones[n] = kFT4_Costas_pattern[m][k];
+                ++n;
+            }
         }
-        else
+    }
+    else
+    {
+        for (int m = 0; m < FT8_NUM_SYNC; ++m)
         {
-            // Pointer to 4 bins of the current symbol
-            const uint8_t* ps = mag_cand + (sym_idx * wf->block_stride);
-
-            ft4_extract_symbol(ps, log174 + bit_idx);
+            for (int k = 0; k < FT8_LENGTH_SYNC; ++k)
+            {
+                blocks[n] = (FT8_SYNC_OFFSET * m) + k;
+                tones[n] = kFT8_Costas_pattern[k];
+                ++n;
+            }
         }
     }
+    return n;
 }
 
-static void ft8_extract_likelihood(const waterfall_t* wf, const candidate_t* cand, float* log174)
+int ft8_find_sync_coarse(const waterfall_t* wf, int num_candidates, candidate_t heap[], int min_score, int num_survivors)
 {
-    const uint8_t* mag_cand = wf->mag + get_index(wf, cand);
+    enum
+    {
+        kMin_offset = -12, ///< Same time offset range as ft8_find_sync()
+        kNum_offsets = 36,
+        kMax_contrast = 510 ///< |2 * p[j] - p[j - 1] - p[j + 1]| for uint8_t magnitudes
+    };
+    const int num_freqs = wf->num_bins - 7; // freq_offset range of ft8_find_sync()
+    if (num_freqs <= 0 || num_candidates <= 0)
+        return 0;
+    if (num_survivors <= 0)
+        num_survivors = 4 * num_candidates;
+
+    int sync_blocks[FT8_NUM_SYNC * FT8_LENGTH_SYNC];
+    int sync_tones[FT8_NUM_SYNC * FT8_LENGTH_SYNC];
+    const int num_sync = sync_symbols(wf->protocol, sync_blocks, sync_tones);
+
+    // Coarse stage, on the (time_sub 0, freq_sub 0) plane only: the contrast of each bin against its two
+    // frequency neighbours, summed over the expected Costas tones. Whole rows at a time, no branches inside
+    int16_t* contrast = malloc(sizeof(int16_t) * (wf->num_blocks > 0 ? wf->num_blocks : 1) * wf->num_bins);
+    int16_t* coarse = malloc(sizeof(int16_t) * kNum_offsets * num_freqs);
+    uint8_t* marked = calloc(wf->time_osr * wf->freq_osr * kNum_offsets, num_freqs);
+    int32_t* sum = malloc(sizeof(int32_t) * num_freqs);
+    if (contrast == NULL || coarse == NULL || marked == NULL || sum == NULL)
+    {
+        free(contrast);
+        free(coarse);
+        free(marked);
+        free(sum);
+        return ft8_find_sync(wf, num_candidates, heap, min_score);
+    }
+    for (int block = 0; block < wf->num_blocks; ++block)
+    {
+        const uint8_t* p = wf->mag + block * wf->block_stride;
+        int16_t* c = contrast + block * wf->num_bins;
+        c[0] = p[0] - p[1];
+        for (int bin = 1; bin + 1 < wf->num_bins; ++bin)
+            c[bin] = 2 * p[bin] - p[bin - 1] - p[bin + 1];
+        c[wf->num_bins - 1] = p[wf->num_bins - 1] - p[wf->num_bins - 2];
+    }
 
-    // Go over FSK tones and skip Costas sync symbols
-    for (int k = 0; k < FT8_ND; ++k)
+    int histogram[2 * kMax_contrast + 1] = { 0 };
+    for (int t = 0; t < kNum_offsets; ++t)
     {
-        // Skip either 7 or 14 sync symbols
-        // TODO: replace magic numbers with constants
-        int sym_idx = k + ((k < 29) ? 7 : 14);
-        int bit_idx = 3 * k;
+        memset(sum, 0, sizeof(int32_t) * num_freqs);
+        int count = 0;
+        for (int s = 0; s < num_sync; ++s)
+        {
+            int block = kMin_offset + t + sync_blocks[s];
+            if (block < 0 || block >= wf->num_blocks)
+                continue;
+            const int16_t* c = contrast + block * wf->num_bins + sync_tones[s];
+            for (int f = 0; f < num_freqs; ++f)
+                sum[f] += c[f];
+            ++count;
+        }
+        int16_t* row = coarse + t * num_freqs;
+        for (int f = 0; f < num_freqs; ++f)
+        {
+            row[f] = (count > 0) ? sum[f] / count : -kMax_contrast;
+            ++histogram[row[f] + kMax_contrast];
+        }
+    }
 
-        // Check for time boundaries
-        int block = cand->time_offset + sym_idx;
-        if ((block < 0) || (block >= wf->num_blocks))
+    // Keep (about) the num_survivors best coarse positions
+    int threshold = -kMax_contrast;
+    for (int level = 2 * kMax_contrast, kept = 0; level >= 0; --level)
+    {
+        kept += histogram[level];
+        if (kept >= num_survivors)
         {
-            log174[bit_idx + 0] = 0;
-            log174[bit_idx + 1] = 0;
-            log174[bit_idx + 2] = 0;
+            threshold = level - kMax_contrast;
+            break;
         }
-        else
+    }
+
+    // Mark every point of the full grid within one symbol and one tone of a survivor
+    // Neighbours at +1 exist only for subdivision 0, since time_sub/freq_sub > 0 lie between two coarse points
+    for (int t = 0; t < kNum_offsets; ++t)
+    {
+        for (int f = 0; f < num_freqs; ++f)
         {
-            // Pointer to 8 bins of the current symbol
-            const uint8_t* ps = mag_cand + (sym_idx * wf->block_stride);
+            if (coarse[t * num_freqs + f] < threshold)
+                continue;
+            for (int time_sub = 0; time_sub < wf->time_osr; ++time_sub)
+            {
+                for (int freq_sub = 0; freq_sub < wf->freq_osr; ++freq_sub)
+                {
+                    uint8_t* plane = marked + (time_sub * wf->freq_osr + freq_sub) * kNum_offsets * num_freqs;
+                    for (int dt = -1; dt <= ((time_sub == 0) ? 1 : 0); ++dt)
+                    {
+                        if (t + dt < 0 || t + dt >= kNum_offsets)
+                            continue;
+                        for (int df = -1; df <= ((freq_sub == 0) ? 1 : 0); ++df)
+                        {
+                            if (f + df >= 0 && f + df < num_freqs)
+                                plane[(t + dt) * num_freqs + f + df] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-            ft8_extract_symbol(ps, log174 + bit_idx);
+    // Fine stage: exact score at the marked points, in the same order as the exhaustive search
+    int heap_size = 0;
+    candidate_t candidate;
+    const uint8_t* mark = marked;
+    for (candidate.time_sub = 0; candidate.time_sub < wf->time_osr; ++candidate.time_sub)
+    {
+        for (candidate.freq_sub = 0; candidate.freq_sub < wf->freq_osr; ++candidate.freq_sub)
+        {
+            for (candidate.time_offset = kMin_offset; candidate.time_offset < kMin_offset + kNum_offsets; ++candidate.time_offset)
+            {
+                for (candidate.freq_offset = 0; candidate.freq_offset < num_freqs; ++candidate.freq_offset, ++mark)
+                {
+                    if (!*mark)
+                        continue;
+                    if (wf->protocol == PROTO_FT4)
+                    {
+                        candidate.score = ft4_sync_score(wf, &candidate);
+                    }
+                    else
+                    {
+                        candidate.score = ft8_sync_score(wf, &candidate);
+                    }
+                    if (candidate.score < min_score)
+                        continue;
+                    heap_push(heap, &heap_size, num_candidates, &candidate);
+                }
+            }
         }
     }
+    free(contrast);
+    free(coarse);
+    free(marked);
+    free(sum);
+
+    heap_sort(heap, heap_size);
+    return heap_size;
 }
 
-static void ftx_normalize_logl(float* log174)
+/// Add a candidate to the min-heap holding the best num_candidates
+static void heap_push(candidate_t heap[], int* heap_size, int num_candidates, const candidate_t* candidate)
 {
-    // Compute the variance of log174
-    float sum = 0;
-    float sum2 = 0;
-    for (int i = 0; i < FTX_LDPC_N; ++i)
+    // If the heap is full AND the current candidate is better than
+    // the worst in the heap, we remove the worst and make space
+    if (*heap_size == num_candidates && candidate->score > heap[0].score)
     {
-        sum += log174[i];
-        sum2 += log174[i] * log174[i];
+        heap[0] = heap[*heap_size - 1];
+        --*heap_size;
+        heapify_down(heap, *heap_size);
     }
-    float inv_n = 1.0f / FTX_LDPC_N;
-    float variance = (sum2 - (sum * sum * inv_n)) * inv_n;
 
-    // Normalize log174 distribution and scale it with experimentally found coefficient
-    float norm_factor = sqrtf(24.0f / variance);
-    for (int i = 0; i < FTX_LDPC_N; ++i)
+    // If there's free space in the heap, we add the current candidate
+    if (*heap_size < num_candidates)
     {
-        log174[i] *= norm_factor;
+        heap[*heap_size] = *candidate;
+        ++*heap_size;
+        heapify_up(heap, *heap_size);
     }
 }
 
-bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* message, int max_iterations, decode_status_t* status)
+/// Sort the candidates by sync strength - here we benefit from the heap structure
+static void heap_sort(candidate_t heap[], int heap_size)
 {
-    float log174[FTX_LDPC_N]; // message bits encoded as likelihood
-    if (wf->protocol == PROTO_FT4)
+    int len_unsorted = heap_size;
+    while (len_unsorted > 1)
     {
-        ft4_extract_likelihood(wf, cand, log174);
+        candidate_t tmp = heap[len_unsorted - 1];
+        heap[len_unsorted - 1] = heap[0];
+        heap[0] = tmp;
+        len_unsorted--;
+        heapify_down(heap, len_unsorted);
     }
-    else
+}
+
+// GCC vector extensions, as in ldpc.c: one data symbol per lane, four lanes to a 128-bit register.
+// The values are small integers (uint8_t magnitudes and their differences), so every lane computes exactly
+// what the scalar code did, and sums of them are exact in any order
+#define LLR_LANES 4
+#define LLR_GROUPS ((FT4_ND + LLR_LANES - 1) / LLR_LANES) ///< Lane groups for the longer of the two messages
+typedef float llr_f __attribute__((vector_size(LLR_LANES * sizeof(float))));
+typedef int32_t llr_i __attribute__((vector_size(LLR_LANES * sizeof(int32_t))));
+
+static inline llr_f llr_max(llr_f a, llr_f b)
+{
+    llr_i a_ge = (a >= b);
+    return (llr_f)(((llr_i)a & a_ge) | ((llr_i)b & ~a_ge));
+}
+
+static inline float llr_hsum(llr_f v)
+{
+    float sum = 0;
+    for (int l = 0; l < LLR_LANES; ++l)
+        sum += v[l];
+    return sum;
+}
+
+/// Position of data symbol k in the message, skipping the sync symbols
+static int data_symbol(ftx_protocol_t protocol, int k)
+{
+    // Skip 7 or 14 sync symbols for FT8; 5, 9 or 13 for FT4 (counting its ramp-up symbol)
+    if (protocol == PROTO_FT4)
+        return k + ((k < 29) ? 5 : ((k < 58) ? 9 : 13));
+    return k + ((k < 29) ? 7 : 14);
+}
+
+/// Magnitudes of a candidate's data symbols, transposed so that tones[t][g] holds tone t of data symbols
+/// g * LLR_LANES onwards, one per lane. Symbols outside the waterfall, and the lanes past the last, are zero.
+/// @return Number of lane groups
+static int gather_tones(const waterfall_t* wf, const candidate_t* cand, int num_tones, llr_f tones[][LLR_GROUPS])
+{
+    const int num_data = (wf->protocol == PROTO_FT4) ? FT4_ND : FT8_ND;
+    const int num_groups = (num_data + LLR_LANES - 1) / LLR_LANES;
+    const uint8_t* mag_cand = wf->mag + get_index(wf, cand);
+
+    memset(tones, 0, sizeof(tones[0]) * num_tones);
+    for (int k = 0; k < num_data; ++k)
     {
-        ft8_extract_likelihood(wf, cand, log174);
+        const int sym_idx = data_symbol(wf->protocol, k);
+        const int block = cand->time_offset + sym_idx;
+        if ((block < 0) || (block >= wf->num_blocks))
+            continue;
+        const uint8_t* ps = mag_cand + (sym_idx * wf->block_stride);
+        for (int t = 0; t < num_tones; ++t)
+            tones[t][k / LLR_LANES][k % LLR_LANES] = ps[t];
     }
+    return num_groups;
+}
 
-    ftx_normalize_logl(log174);
+/// Scale factor giving the log-likelihoods the variance (24) the LDPC decoders were tuned for
+static float logl_norm_factor(float sum, float sum2)
+{
+    float inv_n = 1.0f / FTX_LDPC_N;
+    float variance = (sum2 - (sum * sum * inv_n)) * inv_n;
+    return sqrtf(24.0f / variance);
+}
 
-    uint8_t plain174[FTX_LDPC_N]; // message bits (0/1)
-    bp_decode(log174, max_iterations, plain174, &status->ldpc_errors);
-    // ldpc_decode(log174, max_iterations, plain174, &status->ldpc_errors);
+void ft8_extract_logl(const waterfall_t* wf, const candidate_t* cand, float log174[])
+{
+    const bool is_ft4 = (wf->protocol == PROTO_FT4);
+    const int num_bits = is_ft4 ? 2 : 3;
+    const int num_tones = 1 << num_bits;
+    const uint8_t* gray_map = is_ft4 ? kFT4_Gray_map : kFT8_Gray_map;
+
+    llr_f tones[8][LLR_GROUPS];
+    const int num_groups = gather_tones(wf, cand, num_tones, tones);
+
+    // Log-likelihood of bit b of each symbol: its strongest tone whose Gray code has the bit set, less the
+    // strongest without it. The Gray map only decides which tone rows go into which maximum
+    llr_f bits[3][LLR_GROUPS];
+    llr_f sum = { 0 }, sum2 = { 0 };
+    for (int g = 0; g < num_groups; ++g)
+    {
+        for (int b = 0; b < num_bits; ++b)
+        {
+            const int mask = num_tones >> (b + 1);
+            llr_f max_zero = tones[gray_map[0]][g];
+            llr_f max_one = tones[gray_map[mask]][g];
+            for (int j = 1; j < num_tones; ++j)
+            {
+                if ((j & mask) == 0)
+                    max_zero = llr_max(max_zero, tones[gray_map[j]][g]);
+                else if (j != mask)
+                    max_one = llr_max(max_one, tones[gray_map[j]][g]);
+            }
+            bits[b][g] = max_one - max_zero;
+            sum += bits[b][g];
+            sum2 += bits[b][g] * bits[b][g];
+        }
+    }
 
-    if (status->ldpc_errors > 0)
+    // Normalize the distribution on the way out; the symbols' bits are interleaved in log174
+    const float norm_factor = logl_norm_factor(llr_hsum(sum), llr_hsum(sum2));
+    const int num_data = FTX_LDPC_N / num_bits;
+    for (int b = 0; b < num_bits; ++b)
     {
-        return false;
+        for (int g = 0; g < num_groups; ++g)
+            bits[b][g] *= norm_factor;
+        for (int k = 0; k < num_data; ++k)
+            log174[num_bits * k + b] = bits[b][k / LLR_LANES][k % LLR_LANES];
     }
+}
 
-    // Extract payload + CRC (first FTX_LDPC_K bits) packed into a byte array
+bool ft8_decode_plain(ftx_protocol_t protocol, const uint8_t plain174[], message_t* message, decode_status_t* status)
+{
+    // Extract payload + CRC (first FTX_LDPC_K bits) packed into a byte array: the leading bytes of the packed codeword
+    codeword174_t packed;
+    ldpc_pack(plain174, &packed);
     uint8_t a91[FTX_LDPC_K_BYTES];
-    pack_bits(plain174, FTX_LDPC_K, a91);
+    for (int i = 0; i < FTX_LDPC_K_BYTES; ++i)
+        a91[i] = (uint8_t)(packed.w[i / 8] >> (56 - 8 * (i % 8)));
+    a91[FTX_LDPC_K_BYTES - 1] &= (uint8_t)(0xFF00u >> (FTX_LDPC_K % 8)); // Just the payload and CRC bits
 
     // Extract CRC and check it
     status->crc_extracted = ftx_extract_crc(a91);
@@ -352,7 +764,7 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
         return false;
     }
 
-    if (wf->protocol == PROTO_FT4)
+    if (protocol == PROTO_FT4)
     {
         // '[..] for FT4 only, in order to avoid transmitting a long string of zeros when sending CQ messages,
         // the assembled 77-bit message is bitwise exclusive-OR’ed with [a] pseudorandom sequence before computing the CRC and FEC parity bits'
@@ -362,12 +774,9 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
         }
     }
 
-    status->unpack_status = unpack77(a91, message->text);
-
-    if (status->unpack_status < 0)
-    {
-        return false;
-    }
+    memcpy(message->payload, a91, sizeof(message->payload));
+    message->text[0] = '\0';
+    status->unpack_status = 0;
 
     // Reuse binary message CRC as hash value for the message
     message->hash = status->crc_extracted;
@@ -375,14 +784,41 @@ bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* messa
     return true;
 }
 
-static float max2(float a, float b)
+bool ft8_unpack_message(message_t* message, decode_status_t* status)
+{
+    int rc = unpack77(message->payload, message->text);
+    if (status != NULL)
+    {
+        status->unpack_status = rc;
+    }
+    if (rc < 0)
+    {
+        message->text[0] = '\0';
+        return false;
+    }
+    return true;
+}
+
+bool ft8_same_message(const message_t* a, const message_t* b)
 {
-    return (a >= b) ? a : b;
+    return a->hash == b->hash && memcmp(a->payload, b->payload, sizeof(a->payload)) == 0;
 }
 
-static float max4(float a, float b, float c, float d)
+bool ft8_decode(const waterfall_t* wf, const candidate_t* cand, message_t* message, int max_iterations, decode_status_t* status)
 {
-    return max2(max2(a, b), max2(c, d));
+    float log174[FTX_LDPC_N]; // message bits encoded as likelihood
+    ft8_extract_logl(wf, cand, log174);
+
+    uint8_t plain174[FTX_LDPC_N]; // message bits (0/1)
+    bp_decode(log174, max_iterations, plain174, &status->ldpc_errors);
+    // ldpc_decode(log174, max_iterations, plain174, &status->ldpc_errors);
+
+    if (status->ldpc_errors > 0)
+    {
+        return false;
+    }
+
+    return ft8_decode_plain(wf->protocol, plain174, message, status);
 }
 
 static void heapify_down(candidate_t heap[], int heap_size)
@@ -433,118 +869,3 @@ static void heapify_up(candidate_t heap[], int heap_size)
         current = parent;
     }
 }
-
-// Compute unnormalized log likelihood log(p(1) / p(0)) of 2 message bits (1 FSK symbol)
-static void ft4_extract_symbol(const uint8_t* wf, float* logl)
-{
-    // Cleaned up code for the simple case of n_syms==1
-    float s2[4];
-
-    for (int j = 0; j < 4; ++j)
-    {
-        s2[j] = (float)wf[kFT4_Gray_map[j]];
-    }
-
-    logl[0] = max2(s2[2], s2[3]) - max2(s2[0], s2[1]);
-    logl[1] = max2(s2[1], s2[3]) - max2(s2[0], s2[2]);
-}
-
-// Compute unnormalized log likelihood log(p(1) / p(0)) of 3 message bits (1 FSK symbol)
-static void ft8_extract_symbol(const uint8_t* wf, float* logl)
-{
-    // Cleaned up code for the simple case of n_syms==1
-    float s2[8];
-
-    for (int j = 0; j < 8; ++j)
-    {
-        s2[j] = (float)wf[kFT8_Gray_map[j]];
-    }
-
-    logl[0] = max4(s2[4], s2[5], s2[6], s2[7]) - max4(s2[0], s2[1], s2[2], s2[3]);
-    logl[1] = max4(s2[2], s2[3], s2[6], s2[7]) - max4(s2[0], s2[1], s2[4], s2[5]);
-    logl[2] = max4(s2[1], s2[3], s2[5], s2[7]) - max4(s2[0], s2[2], s2[4], s2[6]);
-}
-
-// Compute unnormalized log likelihood log(p(1) / p(0)) of bits corresponding to several FSK symbols at once
-static void ft8_decode_multi_symbols(const uint8_t* wf, int num_bins, int n_syms, int bit_idx, float* log174)
-{
-    const int n_bits = 3 * n_syms;
-    const int n_tones = (1 << n_bits);
-
-    float s2[n_tones];
-
-    for (int j = 0; j < n_tones; ++j)
-    {
-        int j1 = j & 0x07;
-        if (n_syms == 1)
-        {
-            s2[j] = (float)wf[kFT8_Gray_map[j1]];
-            continue;
-        }
-        int j2 = (j >> 3) & 0x07;
-        if (n_syms == 2)
-        {
-            s2[j] = (float)wf[kFT8_Gray_map[j2]];
-            s2[j] += (float)wf[kFT8_Gray_map[j1] + 4 * num_bins];
-            continue;
-        }
-        int j3 = (j >> 6) & 0x07;
-        s2[j] = (float)wf[kFT8_Gray_map[j3]];
-        s2[j] += (float)wf[kFT8_Gray_map[j2] + 4 * num_bins];
-        s2[j] += (float)wf[kFT8_Gray_map[j1] + 8 * num_bins];
-    }
-
-    // Extract bit significance (and convert them to float)
-    // 8 FSK tones = 3 bits
-    for (int i = 0; i < n_bits; ++i)
-    {
-        if (bit_idx + i >= FTX_LDPC_N)
-        {
-            // Respect array size
-            break;
-        }
-
-        uint16_t mask = (n_tones >> (i + 1));
-        float max_zero = -1000, max_one = -1000;
-        for (int n = 0; n < n_tones; ++n)
-        {
-            if (n & mask)
-            {
-                max_one = max2(max_one, s2[n]);
-            }
-            else
-            {
-                max_zero = max2(max_zero, s2[n]);
-            }
-        }
-
-        log174[bit_idx + i] = max_one - max_zero;
-    }
-}
-
-// Packs a string of bits each represented as a zero/non-zero byte in plain[],
-// as a string of packed bits starting from the MSB of the first byte of packed[]
-static void pack_bits(const uint8_t bit_array[], int num_bits, uint8_t packed[])
-{
-    int num_bytes = (num_bits + 7) / 8;
-    for (int i = 0; i < num_bytes; ++i)
-    {
-        packed[i] = 0;
-    }
-
-    uint8_t mask = 0x80;
-    int byte_idx = 0;
-    for (int i = 0; i < num_bits; ++i)
-    {
-        if (bit_array[i])
-        {
-            packed[byte_idx] |= mask;
-        }
-        mask >>= 1;
-        if (!mask)
-        {
-            mask = 0x80;
-            ++byte_idx;
-        }
-    }
-}
\ No newline at end of file
@@ -22,6 +22,7 @@ extern "C"
         int max_blocks;          ///< number of blocks (symbols) allocated in the mag array
         int num_blocks;          ///< number of blocks (symbols) stored in the mag array
         int num_bins;            ///< number of FFT bins in terms of 6.25 Hz
+        int min_bin;             ///< FFT bin of the first one stored (bin b is at (min_bin + b) * 6.25 Hz), when only part of the band is kept
         int time_osr;            ///< number of time subdivisions
         int freq_osr;            ///< number of frequency subdivisions
         uint8_t* mag;            ///< FFT magnitudes stored as uint8_t[blocks][time_osr][freq_osr][num_bins]
@@ -43,9 +44,9 @@ extern "C"
     /// Structure that holds the decoded message
     typedef struct
     {
-        // TODO: check again that this size is enough
-        char text[25]; ///< Plain text
+        char text[35]; ///< Plain text, empty until ft8_unpack_message(); room for two hashed callsigns resolved in full
         uint16_t hash; ///< Hash value to be used in hash table and quick checking for duplicates
+        uint8_t payload[10]; ///< The 77-bit message as passed to ft8_encode()/ft4_encode() (for regenerating the signal)
       // Store so we can display them after sorting
       float freq_hz;   // We will sort on this
       float time_sec;
@@ -71,7 +72,48 @@ extern "C"
     /// @return Number of candidates filled in the heap
     int ft8_find_sync(const waterfall_t* power, int num_candidates, candidate_t heap[], int min_score);
 
-    /// Attempt to decode a message candidate. Extracts the bit probabilities, runs LDPC decoder, checks CRC and unpacks the message in plain text.
+    /// Coarse-to-fine version of ft8_find_sync(). A cheap pass sums the frequency contrast of the Costas tones
+    /// on one time/frequency subdivision only and keeps the num_survivors best positions; the exact score is
+    /// then computed only within one symbol and one tone of those. Much faster on wide waterfalls, but may miss
+    /// weak candidates that the exhaustive search would find.
+    /// @param[in] power Waterfall data collected during message slot
+    /// @param[in] num_candidates Number of maximum candidates (size of heap array)
+    /// @param[in,out] heap Array of candidate_t type entries (with num_candidates allocated entries)
+    /// @param[in] min_score Minimal score allowed for pruning unlikely candidates (can be zero for no effect)
+    /// @param[in] num_survivors Coarse positions to refine (0 for 4 * num_candidates)
+    /// @return Number of candidates filled in the heap
+    int ft8_find_sync_coarse(const waterfall_t* power, int num_candidates, candidate_t heap[], int min_score, int num_survivors);
+
+    /// A share of the ft8_find_sync() search, for running the search on several threads: a range of
+    /// time/frequency subdivisions (numbered time_sub * freq_osr + freq_sub) and of frequency offsets.
+    /// Each part keeps a private top-N heap and lists every candidate that got into it, which is a superset
+    /// of those that would get into the shared heap at that point of a search on one thread
+    typedef struct
+    {
+        int sub_begin, sub_end;   ///< Subdivisions [sub_begin, sub_end)
+        int freq_begin, freq_end; ///< Frequency offsets [freq_begin, freq_end)
+        candidate_t* found;       ///< Candidates that got into the private heap, in search order (allocated by the search)
+        int* order;               ///< Their positions in the order of a search on one thread
+        int num_found;
+    } ft8_sync_part_t;
+
+    /// Split the ft8_find_sync() search into at most max_parts parts of about the same size: by subdivisions
+    /// when there are enough of them to go round evenly, otherwise by frequency offsets
+    /// @return Number of parts filled in
+    int ft8_sync_split(const waterfall_t* power, int max_parts, ft8_sync_part_t parts[]);
+
+    /// Search one part. Parts of the same waterfall can be searched concurrently
+    /// @return false if memory could not be allocated
+    bool ft8_find_sync_part(const waterfall_t* power, int num_candidates, int min_score, ft8_sync_part_t* part);
+
+    /// Combine the parts of a search into exactly the candidate list ft8_find_sync() would return, ties
+    /// included, by feeding their candidates to the heap in the order of a search on one thread.
+    /// Frees the parts' lists
+    /// @return Number of candidates filled in the heap
+    int ft8_find_sync_merge(int num_candidates, candidate_t heap[], ft8_sync_part_t parts[], int num_parts);
+
+    /// Attempt to decode a message candidate. Extracts the bit probabilities, runs LDPC decoder and checks CRC.
+    /// Only the binary payload and hash are filled in, so duplicates can be dropped before ft8_unpack_message() formats the text
     /// @param[in] power Waterfall data collected during message slot
     /// @param[in] cand Candidate to decode
     /// @param[out] message message_t structure that will receive the decoded message
@@ -80,6 +122,31 @@ extern "C"
     /// @return True if the decoding was successful, false otherwise (check status for details)
     bool ft8_decode(const waterfall_t* power, const candidate_t* cand, message_t* message, int max_iterations, decode_status_t* status);
 
+    /// First half of ft8_decode(), for callers that run the LDPC decoder themselves (e.g. bp_decode_batch() on many candidates):
+    /// extract the log-likelihoods log(p(1) / p(0)) of the 174 codeword bits of a candidate, normalized for soft-decision LDPC decoding.
+    /// @param[in] power Waterfall data collected during message slot
+    /// @param[in] cand Candidate to decode
+    /// @param[out] log174 FTX_LDPC_N log-likelihoods (positive for a one bit)
+    void ft8_extract_logl(const waterfall_t* power, const candidate_t* cand, float log174[]);
+
+    /// Second half of ft8_decode(): check the CRC of an LDPC decoded codeword and extract the 77-bit payload.
+    /// @param[in] protocol FT4 or FT8
+    /// @param[in] plain174 FTX_LDPC_N hard decisions (0/1) that passed the parity checks
+    /// @param[out] message message_t structure that will receive the payload and hash (text is left empty)
+    /// @param[out] status CRC fields filled in (ldpc_errors is left to the caller)
+    /// @return True if the CRC matched, false otherwise
+    bool ft8_decode_plain(ftx_protocol_t protocol, const uint8_t plain174[], message_t* message, decode_status_t* status);
+
+    /// Unpack a decoded payload in plain text. Kept apart from decoding so that the many candidates that give
+    /// the same payload can be recognized by payload and hash alone, and only new messages pay for the formatting
+    /// @param[in,out] message Decoded message; text is filled in
+    /// @param[out] status unpack_status filled in (may be NULL)
+    /// @return True if the payload unpacked, false otherwise
+    bool ft8_unpack_message(message_t* message, decode_status_t* status);
+
+    /// True if two decoded messages have the same payload
+    bool ft8_same_message(const message_t* a, const message_t* b);
+
 #ifdef __cplusplus
 }
 #endif
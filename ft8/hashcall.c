@@ -0,0 +1,231 @@
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include "hashcall.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASHCALL_SETS (1 << HASHCALL_SET_BITS)
+#define CALL_LENGTH   11 // Characters hashed, as in WSJT-X
+
+static const char kAlphabet[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ/";
+static const char kMagic[8] = { 'F', 'T', '8', 'H', 'A', 'S', 'H', '1' };
+
+// The store, laid out the same in process memory and in a snapshot file. A callsign is kept as
+// the base 38 number ihashcall() makes of it, which fits in 58 bits and gives its hashes back with
+// one multiplication, so each slot is a single word that a compare-and-swap can replace
+typedef struct
+{
+    char magic[8];
+    uint32_t sets;
+    uint32_t ways;
+    atomic_uint clock; // Advanced by every save; the stamps in used[] are its values
+    uint32_t reserved;
+    // A set's callsigns and stamps sit side by side, so a lookup reads three adjacent cache lines
+    struct
+    {
+        _Atomic uint64_t call[HASHCALL_WAYS]; // 0 when free
+        atomic_uint used[HASHCALL_WAYS];      // Clock when last saved or looked up
+    } set[HASHCALL_SETS];
+} hashcall_table_t;
+
+static hashcall_table_t Local_table;
+static hashcall_table_t* Table = &Local_table;
+
+// Callsign in base 38, left justified in CALL_LENGTH characters; 0 if it can't be hashed
+static uint64_t pack_call(const char* callsign, int* length)
+{
+    if (*callsign == '<')
+        ++callsign;
+    uint64_t n = 0;
+    int i = 0;
+    for (; callsign[i] != '\0' && callsign[i] != ' ' && callsign[i] != '>'; ++i)
+    {
+        const char* p = (i < CALL_LENGTH) ? strchr(kAlphabet + 1, callsign[i]) : NULL;
+        if (p == NULL)
+            return 0;
+        n = 38 * n + (uint64_t)(p - kAlphabet);
+    }
+    *length = i;
+    for (; i < CALL_LENGTH; ++i)
+        n *= 38;
+    return n;
+}
+
+static void unpack_call(uint64_t n, char* callsign)
+{
+    for (int i = CALL_LENGTH - 1; i >= 0; --i)
+    {
+        callsign[i] = kAlphabet[n % 38];
+        n /= 38;
+    }
+    int length = CALL_LENGTH;
+    while (length > 0 && callsign[length - 1] == ' ')
+        --length;
+    callsign[length] = '\0';
+}
+
+static inline uint32_t hash22(uint64_t call)
+{
+    return (uint32_t)((47055833459ull * call) >> (64 - 22));
+}
+
+// Clock ticks since a slot was used. Another thread may have stamped it after this one read the clock
+static inline uint32_t age_of(uint32_t now, const atomic_uint* used)
+{
+    const uint32_t age = now - atomic_load_explicit(used, memory_order_relaxed);
+    return (age > UINT32_MAX / 2) ? 0 : age;
+}
+
+bool hashcall_compute(const char* callsign, int bits, uint32_t* hash)
+{
+    int length;
+    const uint64_t call = pack_call(callsign, &length);
+    if (call == 0 || (bits != 10 && bits != 12 && bits != 22))
+        return false;
+    *hash = hash22(call) >> (22 - bits);
+    return true;
+}
+
+void hashcall_save(const char* callsign)
+{
+    int length;
+    const uint64_t call = pack_call(callsign, &length);
+    if (call == 0 || length < 3)
+        return;
+
+    hashcall_table_t* table = Table;
+    const uint32_t h22 = hash22(call);
+    _Atomic uint64_t* set = table->set[h22 >> (22 - HASHCALL_SET_BITS)].call;
+    atomic_uint* used = table->set[h22 >> (22 - HASHCALL_SET_BITS)].used;
+    const uint32_t now = atomic_fetch_add_explicit(&table->clock, 1, memory_order_relaxed) + 1;
+
+    // Take over a callsign with the same 22-bit hash (the one heard last wins, as in WSJT-X),
+    // else a free slot, else the least recently used one. If another thread changes that slot
+    // first, look at the set again; after a few tries the callsign just isn't saved this time
+    for (int attempt = 0; attempt < 4; ++attempt)
+    {
+        int victim = 0, rank = -1;
+        uint32_t oldest = 0;
+        uint64_t expected = 0;
+        for (int way = 0; way < HASHCALL_WAYS; ++way)
+        {
+            const uint64_t other = atomic_load_explicit(&set[way], memory_order_relaxed);
+            if (other == call)
+            {
+                atomic_store_explicit(&used[way], now, memory_order_relaxed);
+                return;
+            }
+            const uint32_t age = age_of(now, &used[way]);
+            const int other_rank = (other != 0 && hash22(other) == h22) ? 2 : (other == 0) ? 1 : 0;
+            if (other_rank > rank || (other_rank == rank && age > oldest))
+            {
+                victim = way;
+                rank = other_rank;
+                oldest = age;
+                expected = other;
+            }
+        }
+        if (atomic_compare_exchange_strong_explicit(&set[victim], &expected, call, memory_order_relaxed, memory_order_relaxed))
+        {
+            atomic_store_explicit(&used[victim], now, memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+bool hashcall_lookup(uint32_t hash, int bits, char* callsign)
+{
+    if (bits != 10 && bits != 12 && bits != 22)
+        return false;
+    const uint32_t index = hash >> (bits - HASHCALL_SET_BITS);
+    if (index >= HASHCALL_SETS)
+        return false;
+
+    hashcall_table_t* table = Table;
+    _Atomic uint64_t* set = table->set[index].call;
+    atomic_uint* used = table->set[index].used;
+    const uint32_t now = atomic_load_explicit(&table->clock, memory_order_relaxed);
+    int found = -1;
+    uint32_t newest = 0;
+    uint64_t call = 0;
+    for (int way = 0; way < HASHCALL_WAYS; ++way)
+    {
+        const uint64_t other = atomic_load_explicit(&set[way], memory_order_relaxed);
+        if (other == 0 || hash22(other) >> (22 - bits) != hash)
+            continue;
+        const uint32_t age = age_of(now, &used[way]);
+        if (found < 0 || age < newest)
+        {
+            found = way;
+            newest = age;
+            call = other;
+        }
+    }
+    if (found < 0)
+        return false;
+
+    // Being looked up counts as being heard, for the eviction order
+    atomic_store_explicit(&used[found], now, memory_order_relaxed);
+    unpack_call(call, callsign);
+    return true;
+}
+
+bool hashcall_open(const char* path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || (statbuf.st_size != sizeof(hashcall_table_t) && ftruncate(fd, sizeof(hashcall_table_t)) != 0))
+    {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, sizeof(hashcall_table_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping stays
+    if (map == MAP_FAILED)
+        return false;
+
+    hashcall_table_t* table = (hashcall_table_t*)map;
+    if (memcmp(table->magic, kMagic, sizeof(kMagic)) != 0 || table->sets != HASHCALL_SETS || table->ways != HASHCALL_WAYS)
+    {
+        // New file, or one from another layout
+        memset(table, 0, sizeof(*table));
+        memcpy(table->magic, kMagic, sizeof(kMagic));
+        table->sets = HASHCALL_SETS;
+        table->ways = HASHCALL_WAYS;
+    }
+    hashcall_close();
+    Table = table;
+    return true;
+}
+
+void hashcall_close(void)
+{
+    if (Table != &Local_table)
+        munmap(Table, sizeof(*Table));
+    Table = &Local_table;
+}
+
+void hashcall_clear(void)
+{
+    hashcall_table_t* table = Table;
+    for (int i = 0; i < HASHCALL_SETS; ++i)
+    {
+        for (int way = 0; way < HASHCALL_WAYS; ++way)
+        {
+            atomic_store_explicit(&table->set[i].call[way], 0, memory_order_relaxed);
+            atomic_store_explicit(&table->set[i].used[way], 0, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&table->clock, 0, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#ifndef _INCLUDE_HASHCALL_H_
+#define _INCLUDE_HASHCALL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define HASHCALL_SET_BITS 10 ///< Sets are picked by the 10-bit hash, so a lookup of any width scans one set
+#define HASHCALL_WAYS 16     ///< Callsigns per set; the least recently used one makes room for a new one
+
+    /// Process-wide store of the callsigns heard so far, to resolve the hashed callsigns of messages
+    /// like "<...> PJ4/K1ABC" or "W9XYZ <...> -11". Hashes are those of WSJT-X (ihashcall): 10, 12 and
+    /// 22 bits, the shorter ones being the top bits of the 22-bit one.
+    /// The store holds (1 << HASHCALL_SET_BITS) * HASHCALL_WAYS callsigns, each packed into one 64-bit word,
+    /// so any number of threads can save and look up callsigns at once without locks.
+
+    /// Hash of a callsign, optionally in angle brackets and ended by a space
+    /// @param[in] bits 10, 12 or 22
+    /// @return false if the callsign is empty, longer than 11 characters or has characters other than A-Z, 0-9 and /
+    bool hashcall_compute(const char* callsign, int bits, uint32_t* hash);
+
+    /// Remember a callsign (as for hashcall_compute()) so its hashes can be resolved from now on.
+    /// Callsigns shorter than 3 characters are ignored
+    void hashcall_save(const char* callsign);
+
+    /// Find the most recently used callsign with the given hash
+    /// @param[in] bits 10, 12 or 22
+    /// @param[out] callsign Room for 12 characters
+    /// @return false if no callsign saved has that hash
+    bool hashcall_lookup(uint32_t hash, int bits, char* callsign);
+
+    /// Keep the store in a memory-mapped file instead of process memory, so a restarted program
+    /// resolves the callsigns heard before it stopped. The file is created if needed and starts
+    /// out empty if it wasn't written by the same layout. Call before any thread uses the store;
+    /// the callsigns saved in process memory so far are not carried over
+    /// @return false if the file could not be opened or mapped (errno is set)
+    bool hashcall_open(const char* path);
+
+    /// Unmap the file and go back to the store in process memory
+    void hashcall_close(void);
+
+    /// Forget every callsign
+    void hashcall_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_HASHCALL_H_
@@ -15,16 +15,17 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 
-static int ldpc_check(uint8_t codeword[]);
 static float fast_tanh(float x);
 static float fast_atanh(float x);
 
 // codeword is 174 log-likelihoods.
 // plain is a return value, 174 ints, to be 0 or 1.
 // max_iters is how hard to try.
-// ok == 87 means success.
+// ok == 0 (no parity errors) means success.
 void ldpc_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
 {
     float m[FTX_LDPC_M][FTX_LDPC_N]; // ~60 kB
@@ -60,15 +61,17 @@ void ldpc_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
             }
         }
 
+        codeword174_t packed = { { 0 } };
         for (int i = 0; i < FTX_LDPC_N; i++)
         {
             float l = codeword[i];
             for (int j = 0; j < 3; j++)
                 l += e[kFTX_LDPC_Mn[i][j] - 1][i];
             plain[i] = (l > 0) ? 1 : 0;
+            packed.w[i / 64] |= (uint64_t)plain[i] << (63 - i % 64);
         }
 
-        int errors = ldpc_check(plain);
+        int errors = ldpc_check_packed(&packed);
 
         if (errors < min_errors)
         {
@@ -103,61 +106,135 @@ void ldpc_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
     *ok = min_errors;
 }
 
-//
-// does a 174-bit codeword pass the FT8's LDPC parity checks?
-// returns the number of parity errors.
-// 0 means total success.
-//
-static int ldpc_check(uint8_t codeword[])
+// Edges of the parity check graph in check order: edges check_start[m] .. check_start[m + 1] - 1
+// belong to check m, in the order of kFTX_LDPC_Nm[m]. Messages live in flat arrays indexed by edge,
+// so both halves of an iteration are straight passes over the edges instead of table lookups
+#define LDPC_EDGES (FTX_LDPC_N * 3)
+static struct
+{
+    uint16_t check_start[FTX_LDPC_M + 1];
+    uint8_t edge_var[LDPC_EDGES];       // Bit (variable node) of each edge
+    uint16_t edge_other[LDPC_EDGES][2]; // The other two edges of that bit, in kFTX_LDPC_Mn order
+    uint16_t var_edge[FTX_LDPC_N][3];   // The three edges of each bit, in kFTX_LDPC_Mn order
+    uint64_t check_mask[FTX_LDPC_M][3]; // The bits of each check, packed as in codeword174_t
+} Edges;
+static pthread_once_t Edges_once = PTHREAD_ONCE_INIT;
+
+// A check passes when the bits under its mask have even parity
+static inline __attribute__((always_inline)) int check_packed_body(const codeword174_t* packed)
 {
+    const uint64_t w0 = packed->w[0], w1 = packed->w[1], w2 = packed->w[2];
     int errors = 0;
+    for (int m = 0; m < FTX_LDPC_M; ++m)
+    {
+        uint64_t x = (w0 & Edges.check_mask[m][0]) ^ (w1 & Edges.check_mask[m][1]) ^ (w2 & Edges.check_mask[m][2]);
+        errors += __builtin_popcountll(x) & 1;
+    }
+    return errors;
+}
+
+static int check_packed_generic(const codeword174_t* packed)
+{
+    return check_packed_body(packed);
+}
 
+#if defined(__x86_64__) || defined(__i386__)
+// The same with the POPCNT instruction, which the baseline x86-64 target doesn't assume
+__attribute__((target("popcnt"))) static int check_packed_popcnt(const codeword174_t* packed)
+{
+    return check_packed_body(packed);
+}
+#endif
+
+// Picked by edges_init() for the CPU
+static int (*check_packed)(const codeword174_t* packed) = check_packed_generic;
+
+static void edges_init(void)
+{
+    int e = 0;
     for (int m = 0; m < FTX_LDPC_M; ++m)
     {
-        uint8_t x = 0;
-        for (int i = 0; i < kFTX_LDPC_Num_rows[m]; ++i)
+        Edges.check_start[m] = e;
+        for (int n_idx = 0; n_idx < kFTX_LDPC_Num_rows[m]; ++n_idx, ++e)
         {
-            x ^= codeword[kFTX_LDPC_Nm[m][i] - 1];
+            int n = kFTX_LDPC_Nm[m][n_idx] - 1;
+            Edges.edge_var[e] = n;
+            Edges.check_mask[m][n / 64] |= 1ull << (63 - n % 64);
+            for (int m_idx = 0; m_idx < 3; ++m_idx)
+            {
+                if ((kFTX_LDPC_Mn[n][m_idx] - 1) == m)
+                    Edges.var_edge[n][m_idx] = e;
+            }
         }
-        if (x != 0)
+    }
+    Edges.check_start[FTX_LDPC_M] = e;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("popcnt"))
+        check_packed = check_packed_popcnt;
+#endif
+    for (e = 0; e < LDPC_EDGES; ++e)
+    {
+        const uint16_t* ve = Edges.var_edge[Edges.edge_var[e]];
+        int k = 0;
+        for (int m_idx = 0; m_idx < 3; ++m_idx)
         {
-            ++errors;
+            if (ve[m_idx] != e)
+                Edges.edge_other[e][k++] = ve[m_idx];
         }
     }
-    return errors;
 }
 
+int ldpc_check_packed(const codeword174_t* packed)
+{
+    pthread_once(&Edges_once, edges_init);
+    return check_packed(packed);
+}
+
+void ldpc_pack(const uint8_t plain[], codeword174_t* packed)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        const int count = (FTX_LDPC_N - 64 * i < 64) ? FTX_LDPC_N - 64 * i : 64;
+        uint64_t w = 0;
+        for (int b = 0; b < count; ++b)
+            w = (w << 1) | (plain[64 * i + b] != 0);
+        packed->w[i] = (count < 64) ? w << (64 - count) : w;
+    }
+}
+
+// The same flooding schedule and arithmetic as ever (every sum and product in the same order),
+// so the results are bit for bit what the original nested-table version gave
 void bp_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
 {
-    float tov[FTX_LDPC_N][3];
-    float toc[FTX_LDPC_M][7];
+    float tov[LDPC_EDGES]; // check -> bit messages
+    float toc[LDPC_EDGES]; // bit -> check messages, as tanh(-T/2)
 
+    pthread_once(&Edges_once, edges_init);
     int min_errors = FTX_LDPC_M;
 
     // initialize message data
-    for (int n = 0; n < FTX_LDPC_N; ++n)
-    {
-        tov[n][0] = tov[n][1] = tov[n][2] = 0;
-    }
+    for (int e = 0; e < LDPC_EDGES; ++e)
+        tov[e] = 0;
 
     for (int iter = 0; iter < max_iters; ++iter)
     {
         // Do a hard decision guess (tov=0 in iter 0)
-        int plain_sum = 0;
+        codeword174_t packed = { { 0 } };
         for (int n = 0; n < FTX_LDPC_N; ++n)
         {
-            plain[n] = ((codeword[n] + tov[n][0] + tov[n][1] + tov[n][2]) > 0) ? 1 : 0;
-            plain_sum += plain[n];
+            const uint16_t* ve = Edges.var_edge[n];
+            plain[n] = ((codeword[n] + tov[ve[0]] + tov[ve[1]] + tov[ve[2]]) > 0) ? 1 : 0;
+            packed.w[n / 64] |= (uint64_t)plain[n] << (63 - n % 64);
         }
 
-        if (plain_sum == 0)
+        if ((packed.w[0] | packed.w[1] | packed.w[2]) == 0)
         {
             // message converged to all-zeros, which is prohibited
             break;
         }
 
         // Check to see if we have a codeword (check before we do any iter)
-        int errors = ldpc_check(plain);
+        int errors = check_packed(&packed);
 
         if (errors < min_errors)
         {
@@ -171,45 +248,449 @@ void bp_decode(float codeword[], int max_iters, uint8_t plain[], int* ok)
         }
 
         // Send messages from bits to check nodes
+        for (int e = 0; e < LDPC_EDGES; ++e)
+        {
+            float Tnm = codeword[Edges.edge_var[e]] + tov[Edges.edge_other[e][0]] + tov[Edges.edge_other[e][1]];
+            toc[e] = fast_tanh(-Tnm / 2);
+        }
+
+        // send messages from check nodes to variable nodes
         for (int m = 0; m < FTX_LDPC_M; ++m)
         {
-            for (int n_idx = 0; n_idx < kFTX_LDPC_Num_rows[m]; ++n_idx)
+            const int first = Edges.check_start[m];
+            const int last = Edges.check_start[m + 1];
+            for (int e = first; e < last; ++e)
             {
-                int n = kFTX_LDPC_Nm[m][n_idx] - 1;
-                // for each (n, m)
-                float Tnm = codeword[n];
-                for (int m_idx = 0; m_idx < 3; ++m_idx)
+                float Tmn = 1.0f;
+                for (int e2 = first; e2 < last; ++e2)
                 {
-                    if ((kFTX_LDPC_Mn[n][m_idx] - 1) != m)
-                    {
-                        Tnm += tov[n][m_idx];
-                    }
+                    if (e2 != e)
+                        Tmn *= toc[e2];
                 }
-                toc[m][n_idx] = fast_tanh(-Tnm / 2);
+                tov[e] = -2 * fast_atanh(Tmn);
             }
         }
+    }
 
-        // send messages from check nodes to variable nodes
+    *ok = min_errors;
+}
+
+// GCC vector extensions: one codeword per lane, four lanes to a 128-bit register (SSE2, NEON).
+// Every lane does exactly the scalar operations, in the same order
+typedef float lanes_f __attribute__((vector_size(FTX_LDPC_LANES * sizeof(float))));
+typedef int32_t lanes_i __attribute__((vector_size(FTX_LDPC_LANES * sizeof(int32_t))));
+
+static inline lanes_f lanes_splat(float x)
+{
+    lanes_f v;
+    for (int l = 0; l < FTX_LDPC_LANES; ++l)
+        v[l] = x;
+    return v;
+}
+
+static inline lanes_f fast_tanh_lanes(lanes_f x)
+{
+    lanes_f x2 = x * x;
+    lanes_f a = x * (945.0f + x2 * (105.0f + x2));
+    lanes_f b = 945.0f + x2 * (420.0f + x2 * 15.0f);
+    lanes_i below = x < lanes_splat(-4.97f);
+    lanes_i above = x > lanes_splat(4.97f);
+    lanes_i r = (lanes_i)(a / b);
+    r = (r & ~(below | above)) | ((lanes_i)lanes_splat(-1.0f) & below) | ((lanes_i)lanes_splat(1.0f) & above);
+    return (lanes_f)r;
+}
+
+static inline lanes_f fast_atanh_lanes(lanes_f x)
+{
+    lanes_f x2 = x * x;
+    lanes_f a = x * (945.0f + x2 * (-735.0f + x2 * 64.0f));
+    lanes_f b = (945.0f + x2 * (-1050.0f + x2 * 225.0f));
+    return a / b;
+}
+
+// Each lane works through its own codeword and takes the next one as soon as it finishes, so a batch costs
+// about as many iterations as its codewords need in total, not FTX_LDPC_LANES times the slowest one
+void bp_decode_batch(float codewords[][FTX_LDPC_N], int count, int max_iters, uint8_t plain[][FTX_LDPC_N], int ok[], int iters[])
+{
+    lanes_f llr[FTX_LDPC_N];
+    lanes_f tov[LDPC_EDGES];
+    lanes_f toc[LDPC_EDGES];
+    int lane_cw[FTX_LDPC_LANES];   // Codeword in each lane, -1 when idle
+    int lane_iter[FTX_LDPC_LANES]; // Message passing rounds done on it
+    int min_errors[FTX_LDPC_LANES];
+
+    pthread_once(&Edges_once, edges_init);
+
+    for (int l = 0; l < FTX_LDPC_LANES; ++l)
+        lane_cw[l] = -1;
+    int next = 0;   // Next codeword to load
+    int active = 0; // Lanes with a codeword
+
+    for (;;)
+    {
+        // (Re)load idle lanes, starting each codeword from scratch
+        for (int l = 0; l < FTX_LDPC_LANES && next < count; ++l)
+        {
+            if (lane_cw[l] >= 0)
+                continue;
+            for (int n = 0; n < FTX_LDPC_N; ++n)
+                llr[n][l] = codewords[next][n];
+            for (int e = 0; e < LDPC_EDGES; ++e)
+                tov[e][l] = 0.0f;
+            lane_cw[l] = next++;
+            lane_iter[l] = 0;
+            min_errors[l] = FTX_LDPC_M;
+            ++active;
+        }
+        if (active == 0)
+            break;
+
+        // Hard decisions as lane masks (-1 for a one bit)
+        lanes_i bits[FTX_LDPC_N];
+        lanes_i plain_sum = { 0 };
         for (int n = 0; n < FTX_LDPC_N; ++n)
         {
-            for (int m_idx = 0; m_idx < 3; ++m_idx)
+            const uint16_t* ve = Edges.var_edge[n];
+            bits[n] = (llr[n] + tov[ve[0]] + tov[ve[1]] + tov[ve[2]]) > lanes_splat(0.0f);
+            plain_sum -= bits[n];
+        }
+        // Parity checks, all lanes at once
+        lanes_i errors = { 0 };
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            lanes_i x = { 0 };
+            for (int e = Edges.check_start[m]; e < Edges.check_start[m + 1]; ++e)
+                x ^= bits[Edges.edge_var[e]];
+            errors -= x;
+        }
+        for (int l = 0; l < FTX_LDPC_LANES; ++l)
+        {
+            const int i = lane_cw[l];
+            if (i < 0)
+                continue;
+            // Finished: out of iterations (keeping the last decision), converged to all zeros (prohibited) or a codeword
+            bool done = (lane_iter[l] == max_iters);
+            if (!done)
             {
-                int m = kFTX_LDPC_Mn[n][m_idx] - 1;
-                // for each (n, m)
-                float Tmn = 1.0f;
-                for (int n_idx = 0; n_idx < kFTX_LDPC_Num_rows[m]; ++n_idx)
+                for (int n = 0; n < FTX_LDPC_N; ++n)
+                    plain[i][n] = bits[n][l] ? 1 : 0;
+                if (plain_sum[l] == 0)
+                    done = true;
+                else if (errors[l] < min_errors[l])
                 {
-                    if ((kFTX_LDPC_Nm[m][n_idx] - 1) != n)
-                    {
-                        Tmn *= toc[m][n_idx];
-                    }
+                    min_errors[l] = errors[l];
+                    done = (errors[l] == 0);
                 }
-                tov[n][m_idx] = -2 * fast_atanh(Tmn);
             }
+            if (done)
+            {
+                ok[i] = min_errors[l];
+                if (iters != NULL)
+                    iters[i] = lane_iter[l];
+                lane_cw[l] = -1;
+                --active;
+            }
+        }
+        if (active == 0)
+            continue; // Nothing to iterate on; load more or stop
+
+        // Send messages from bits to check nodes
+        for (int e = 0; e < LDPC_EDGES; ++e)
+        {
+            lanes_f Tnm = llr[Edges.edge_var[e]] + tov[Edges.edge_other[e][0]] + tov[Edges.edge_other[e][1]];
+            toc[e] = fast_tanh_lanes(-Tnm / 2);
+        }
+
+        // send messages from check nodes to variable nodes
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            const int first = Edges.check_start[m];
+            const int last = Edges.check_start[m + 1];
+            for (int e = first; e < last; ++e)
+            {
+                lanes_f Tmn = lanes_splat(1.0f);
+                for (int e2 = first; e2 < last; ++e2)
+                {
+                    if (e2 != e)
+                        Tmn *= toc[e2];
+                }
+                tov[e] = -2 * fast_atanh_lanes(Tmn);
+            }
+        }
+        for (int l = 0; l < FTX_LDPC_LANES; ++l)
+        {
+            if (lane_cw[l] >= 0)
+                ++lane_iter[l];
+        }
+    }
+}
+
+// Layered normalized min-sum. The checks are processed one after another, each one using the bit
+// posteriors as already updated by the checks before it in the same iteration, which is what makes it
+// converge in fewer iterations than flooding. A check's outgoing messages are all the same magnitude but
+// one, so each check stores just its two smallest input magnitudes, where the smallest was and the signs.
+#define LAYERED_ALPHA 0.75f // Min-sum overestimates the message magnitudes; scale them down
+
+typedef struct
+{
+    float min1, min2; // Smallest and second smallest input magnitude, times LAYERED_ALPHA
+    uint8_t min_idx;  // Edge (0..6 within the check) that had min1
+    uint8_t signs;    // Bit k set when the message to edge k is negative
+} check_msg_t;
+
+void ldpc_decode_layered(float codeword[], int max_iters, uint8_t plain[], int* ok, int* iters)
+{
+    float post[FTX_LDPC_N]; // Bit posteriors, as log(P(0) / P(1)) (the opposite sign of codeword[])
+    check_msg_t chk[FTX_LDPC_M];
+    int min_errors = FTX_LDPC_M;
+    int iter;
+
+    pthread_once(&Edges_once, edges_init);
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+        post[n] = -codeword[n];
+    memset(chk, 0, sizeof(chk));
+
+    for (iter = 0; iter < max_iters; ++iter)
+    {
+        codeword174_t packed = { { 0 } };
+        for (int n = 0; n < FTX_LDPC_N; ++n)
+        {
+            plain[n] = (post[n] < 0) ? 1 : 0;
+            packed.w[n / 64] |= (uint64_t)plain[n] << (63 - n % 64);
+        }
+        if ((packed.w[0] | packed.w[1] | packed.w[2]) == 0)
+        {
+            // message converged to all-zeros, which is prohibited
+            break;
+        }
+        int errors = check_packed(&packed);
+        if (errors < min_errors)
+        {
+            min_errors = errors;
+            if (errors == 0)
+                break;
+        }
+
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            const int first = Edges.check_start[m];
+            const int degree = Edges.check_start[m + 1] - first;
+            const check_msg_t old = chk[m];
+            float q[7];
+            float min1 = INFINITY, min2 = INFINITY;
+            int min_idx = 0;
+            unsigned signs = 0, parity = 0;
+
+            // Take the check's old message out of each posterior (branch free: the signs are coin flips on weak signals)
+            for (int k = 0; k < degree; ++k)
+            {
+                float r = (k == old.min_idx) ? old.min2 : old.min1;
+                q[k] = post[Edges.edge_var[first + k]] - ((old.signs & (1u << k)) ? -r : r);
+                float mag = fabsf(q[k]);
+                unsigned neg = (q[k] < 0) ? 1 : 0;
+                signs |= neg << k;
+                parity ^= neg;
+                float above = (mag > min1) ? mag : min1;
+                min_idx = (mag < min1) ? k : min_idx;
+                min2 = (above < min2) ? above : min2;
+                min1 = (mag < min1) ? mag : min1;
+            }
+            // and put the new one in
+            min1 *= LAYERED_ALPHA;
+            min2 *= LAYERED_ALPHA;
+            signs = parity ? (~signs & 0x7f) : signs;
+            for (int k = 0; k < degree; ++k)
+            {
+                float r = (k == min_idx) ? min2 : min1;
+                post[Edges.edge_var[first + k]] = q[k] + ((signs & (1u << k)) ? -r : r);
+            }
+            chk[m] = (check_msg_t){ min1, min2, min_idx, signs };
         }
     }
 
     *ok = min_errors;
+    if (iters != NULL)
+        *iters = iter;
+}
+
+// Ordered statistics decoding works on codewords as 174-bit sets
+#define OSD_WORDS ((FTX_LDPC_N + 63) / 64)
+typedef struct
+{
+    uint64_t w[OSD_WORDS];
+} bits174_t;
+
+// Column n of the systematic generator matrix: the message bits that codeword bit n depends on
+static uint64_t Generator_column[FTX_LDPC_N][2];
+static pthread_once_t Generator_once = PTHREAD_ONCE_INIT;
+
+static void generator_init(void)
+{
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+    {
+        for (int k = 0; k < FTX_LDPC_K; ++k)
+        {
+            bool set = (n < FTX_LDPC_K) ? (k == n) : (kFTX_LDPC_generator[n - FTX_LDPC_K][k / 8] & (0x80u >> (k % 8))) != 0;
+            if (set)
+                Generator_column[n][k / 64] |= 1ull << (k % 64);
+        }
+    }
+}
+
+static inline void bits_xor(bits174_t* a, const bits174_t* b)
+{
+    for (int i = 0; i < OSD_WORDS; ++i)
+        a->w[i] ^= b->w[i];
+}
+
+static inline bool bits_equal(const bits174_t* a, const bits174_t* b)
+{
+    for (int i = 0; i < OSD_WORDS; ++i)
+        if (a->w[i] != b->w[i])
+            return false;
+    return true;
+}
+
+// Sum of the reliabilities of the set bits, giving up once it reaches limit
+static float osd_distance(const bits174_t* d, const float rel[], float limit)
+{
+    float sum = 0;
+    for (int i = 0; i < OSD_WORDS; ++i)
+    {
+        for (uint64_t x = d->w[i]; x != 0; x &= x - 1)
+        {
+            sum += rel[64 * i + __builtin_ctzll(x)];
+            if (sum >= limit)
+                return sum;
+        }
+    }
+    return sum;
+}
+
+typedef struct
+{
+    float rel;
+    int n;
+} osd_order_t;
+
+static int osd_compare(const void* a, const void* b)
+{
+    const osd_order_t* oa = a;
+    const osd_order_t* ob = b;
+    if (oa->rel != ob->rel)
+        return (oa->rel < ob->rel) ? 1 : -1; // Most reliable first
+    return oa->n - ob->n;
+}
+
+int osd_decode(const float codeword[], int depth, uint8_t plain[], float* distance)
+{
+    osd_order_t order[FTX_LDPC_N];
+    float rel[FTX_LDPC_N];  // Reliabilities in sorted order
+    bits174_t rows[FTX_LDPC_K];
+    bits174_t hard = { { 0 } };
+    int pivot[FTX_LDPC_K];
+
+    pthread_once(&Generator_once, generator_init);
+
+    // Sort the bits by reliability; from here on bit p stands for codeword bit order[p].n
+    for (int n = 0; n < FTX_LDPC_N; ++n)
+    {
+        order[n].rel = fabsf(codeword[n]);
+        order[n].n = n;
+    }
+    qsort(order, FTX_LDPC_N, sizeof(order[0]), osd_compare);
+    memset(rows, 0, sizeof(rows));
+    for (int p = 0; p < FTX_LDPC_N; ++p)
+    {
+        const int n = order[p].n;
+        rel[p] = order[p].rel;
+        if (codeword[n] > 0)
+            hard.w[p / 64] |= 1ull << (p % 64);
+        for (int i = 0; i < 2; ++i)
+        {
+            for (uint64_t x = Generator_column[n][i]; x != 0; x &= x - 1)
+                rows[64 * i + __builtin_ctzll(x)].w[p / 64] |= 1ull << (p % 64);
+        }
+    }
+
+    // Gaussian elimination: the first FTX_LDPC_K independent bits (the most reliable basis) become the message
+    int rank = 0;
+    for (int p = 0; p < FTX_LDPC_N && rank < FTX_LDPC_K; ++p)
+    {
+        const uint64_t mask = 1ull << (p % 64);
+        int r = rank;
+        while (r < FTX_LDPC_K && !(rows[r].w[p / 64] & mask))
+            ++r;
+        if (r == FTX_LDPC_K)
+            continue; // Depends on more reliable bits
+        bits174_t tmp = rows[r];
+        rows[r] = rows[rank];
+        rows[rank] = tmp;
+        for (r = 0; r < FTX_LDPC_K; ++r)
+        {
+            if (r != rank && (rows[r].w[p / 64] & mask))
+                bits_xor(&rows[r], &rows[rank]);
+        }
+        pivot[rank++] = p;
+    }
+
+    // Order 0: re-encode the hard decisions of the basis
+    bits174_t diff = hard;
+    for (int i = 0; i < FTX_LDPC_K; ++i)
+    {
+        if (hard.w[pivot[i] / 64] & (1ull << (pivot[i] % 64)))
+            bits_xor(&diff, &rows[i]);
+    }
+    // diff is now (codeword XOR hard decisions); flips of basis bits change it by whole rows.
+    // diff == hard is the all-zeros codeword, which is never sent (and would pass the CRC)
+    bits174_t best = diff;
+    float best_distance = bits_equal(&diff, &hard) ? INFINITY : osd_distance(&diff, rel, INFINITY);
+    int tried = 1;
+
+    if (depth >= 1)
+    {
+        for (int i = 0; i < FTX_LDPC_K; ++i)
+        {
+            bits174_t d = diff;
+            bits_xor(&d, &rows[i]);
+            float dist = osd_distance(&d, rel, best_distance);
+            if (dist < best_distance && !bits_equal(&d, &hard))
+            {
+                best_distance = dist;
+                best = d;
+            }
+        }
+        tried += FTX_LDPC_K;
+    }
+    if (depth >= 2)
+    {
+        // Pairs among the least reliable basis bits, where a second error is most likely
+        for (int i = FTX_LDPC_K - FTX_OSD_PAIR_BITS; i < FTX_LDPC_K; ++i)
+        {
+            bits174_t di = diff;
+            bits_xor(&di, &rows[i]);
+            for (int j = i + 1; j < FTX_LDPC_K; ++j)
+            {
+                bits174_t d = di;
+                bits_xor(&d, &rows[j]);
+                float dist = osd_distance(&d, rel, best_distance);
+                if (dist < best_distance && !bits_equal(&d, &hard))
+                {
+                    best_distance = dist;
+                    best = d;
+                }
+            }
+        }
+        tried += FTX_OSD_PAIR_BITS * (FTX_OSD_PAIR_BITS - 1) / 2;
+    }
+
+    // Back from differences to bits, in the original order
+    bits_xor(&best, &hard);
+    for (int p = 0; p < FTX_LDPC_N; ++p)
+        plain[order[p].n] = (best.w[p / 64] >> (p % 64)) & 1;
+    if (distance != NULL)
+        *distance = best_distance;
+    return tried;
 }
 
 // Ideas for approximating tanh/atanh:
@@ -3,19 +3,61 @@
 
 #include <stdint.h>
 
+#include "constants.h"
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    // 174 hard decisions packed 64 to a word, most significant bit first: codeword bit n is bit 63 - n % 64
+    // of w[n / 64], so the bytes of the words in big-endian order are the codeword packed as bytes.
+    typedef struct
+    {
+        uint64_t w[3];
+    } codeword174_t;
+
+    // Pack 174 hard decisions (0 or 1 each).
+    void ldpc_pack(const uint8_t plain[], codeword174_t* packed);
+
+    // Number of the 83 parity checks a packed codeword fails (0 = it is a codeword).
+    // Each check is an AND with a row mask and a popcount.
+    int ldpc_check_packed(const codeword174_t* packed);
+
     // codeword is 174 log-likelihoods.
     // plain is a return value, 174 ints, to be 0 or 1.
     // iters is how hard to try.
-    // ok == 87 means success.
+    // ok == 0 (no parity errors) means success.
     void ldpc_decode(float codeword[], int max_iters, uint8_t plain[], int* ok);
 
     void bp_decode(float codeword[], int max_iters, uint8_t plain[], int* ok);
 
+    // Layered (serial schedule) normalized min-sum: no tanh, about 1 kB of check messages (1.7 kB of stack with the posteriors),
+    // and about half the iterations of bp_decode() to converge. Same arguments and results as bp_decode(),
+    // plus the number of message passing rounds in *iters (if not NULL).
+    void ldpc_decode_layered(float codeword[], int max_iters, uint8_t plain[], int* ok, int* iters);
+
+// Number of codewords bp_decode_batch() works on side by side (one per SIMD lane)
+#define FTX_LDPC_LANES 4
+
+    // Belief propagation on a batch of codewords, FTX_LDPC_LANES at a time, sharing the parity tables.
+    // Each codeword stops on its own (codeword found, all zeros or max_iters) and its lane moves on to the next one;
+    // the results are exactly what bp_decode() gives for each codeword.
+    // codewords: count arrays of 174 log-likelihoods. plain: count hard decisions out.
+    // ok: parity errors per codeword (0 = success). iters: message passing rounds per codeword, or NULL.
+    void bp_decode_batch(float codewords[][FTX_LDPC_N], int count, int max_iters, uint8_t plain[][FTX_LDPC_N], int ok[], int iters[]);
+
+// Number of least reliable message bits whose pairs osd_decode() tries at depth 2
+#define FTX_OSD_PAIR_BITS 40
+
+    // Ordered statistics decoding, for codewords belief propagation could not decode.
+    // Takes the 91 most reliable independent bits as the message, re-encodes it and at depth 1 also every version
+    // with one of those bits flipped, at depth 2 also every pair among the FTX_OSD_PAIR_BITS least reliable of them.
+    // plain gets the candidate closest to the log-likelihoods: always a valid codeword, so only the CRC can
+    // tell whether it is the right one. distance (if not NULL) gets the sum of |log-likelihood| over the bits
+    // it disagrees with. Returns the number of candidates tried.
+    int osd_decode(const float codeword[], int depth, uint8_t plain[], float* distance);
+
 #ifdef __cplusplus
 }
 #endif
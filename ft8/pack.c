@@ -1,4 +1,5 @@
 #include "pack.h"
+#include "hashcall.h"
 #include "text.h"
 
 #include <stdbool.h>
@@ -36,7 +37,15 @@ int32_t pack28(const char* callsign)
         // TODO:
     }
 
-    // TODO: Check for <...> callsign
+    // A callsign in angle brackets goes as its 22-bit hash
+    uint32_t n22;
+    if (callsign[0] == '<')
+    {
+        if (!hashcall_compute(callsign, 22, &n22))
+            return -1;
+        hashcall_save(callsign);
+        return NTOKENS + n22;
+    }
 
     char c6[6] = { ' ', ' ', ' ', ' ', ' ', ' ' };
 
@@ -87,12 +96,11 @@ int32_t pack28(const char* callsign)
         return NTOKENS + MAX22 + n28;
     }
 
-    //char text[13];
-    //if (length > 13) return -1;
-
-    // TODO:
-    // Treat this as a nonstandard callsign: compute its 22-bit hash
-    return -1;
+    // Treat this as a nonstandard callsign: compute its 22-bit hash. It isn't saved, as the
+    // caller may yet decide that the word isn't a callsign at all
+    if (length < 3 || !hashcall_compute(callsign, 22, &n22))
+        return -1;
+    return NTOKENS + n22;
 }
 
 // Check if a string could be a valid standard callsign or a valid
@@ -180,6 +188,10 @@ int pack77_1(const char* msg, uint8_t* b77)
     if (n28a < 0 || n28b < 0)
         return -1;
 
+    // A nonstandard callsign goes in full in a Type 4 message (not implemented yet) unless written as <call>
+    if (((uint32_t)n28a >= NTOKENS && (uint32_t)n28a < NTOKENS + MAX22 && call1[0] != '<') || ((uint32_t)n28b >= NTOKENS && (uint32_t)n28b < NTOKENS + MAX22 && call2[0] != '<'))
+        return -1;
+
     uint16_t igrid4;
 
     // Locate the second delimiter
@@ -0,0 +1,102 @@
+#include "synth.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define GFSK_CONST_K 5.336446f ///< == pi * sqrt(2 / log(2))
+
+void gfsk_pulse(int n_spsym, float symbol_bt, float* pulse)
+{
+    for (int i = 0; i < 3 * n_spsym; ++i)
+    {
+        float t = i / (float)n_spsym - 1.5f;
+        float arg1 = GFSK_CONST_K * symbol_bt * (t + 0.5f);
+        float arg2 = GFSK_CONST_K * symbol_bt * (t - 0.5f);
+        pulse[i] = (erff(arg1) - erff(arg2)) / 2;
+    }
+}
+
+int synth_gfsk_phase(const uint8_t* symbols, int n_sym, float f0, float symbol_bt, float symbol_period, int signal_rate, float* phase)
+{
+    int n_spsym = (int)(0.5f + signal_rate * symbol_period); // Samples per symbol
+    int n_wave = n_sym * n_spsym;                            // Number of output samples
+    float hmod = 1.0f;
+
+    // Compute the smoothed frequency waveform.
+    // Length = (nsym+2)*n_spsym samples, first and last symbols extended
+    float dphi_peak = 2 * M_PI * hmod / n_spsym;
+    float* dphi = malloc(sizeof(float) * (n_wave + 2 * n_spsym));
+    float* pulse = malloc(sizeof(float) * 3 * n_spsym);
+    if (dphi == NULL || pulse == NULL)
+    {
+        free(dphi);
+        free(pulse);
+        return -1;
+    }
+
+    // Shift frequency up by f0
+    for (int i = 0; i < n_wave + 2 * n_spsym; ++i)
+    {
+        dphi[i] = 2 * M_PI * f0 / signal_rate;
+    }
+
+    gfsk_pulse(n_spsym, symbol_bt, pulse);
+
+    for (int i = 0; i < n_sym; ++i)
+    {
+        int ib = i * n_spsym;
+        for (int j = 0; j < 3 * n_spsym; ++j)
+        {
+            dphi[j + ib] += dphi_peak * symbols[i] * pulse[j];
+        }
+    }
+
+    // Add dummy symbols at beginning and end with tone values equal to 1st and last symbol, respectively
+    for (int j = 0; j < 2 * n_spsym; ++j)
+    {
+        dphi[j] += dphi_peak * pulse[j + n_spsym] * symbols[0];
+        dphi[j + n_sym * n_spsym] += dphi_peak * pulse[j] * symbols[n_sym - 1];
+    }
+
+    // Integrate the frequency
+    // The increments are positive, so wrapping by subtraction gives exactly what fmodf() would, much faster
+    const float two_pi = 2 * M_PI;
+    float phi = 0;
+    for (int k = 0; k < n_wave; ++k)
+    { // Don't include dummy symbols
+        phase[k] = phi;
+        phi += dphi[k + n_spsym];
+        while (phi >= two_pi)
+            phi -= two_pi;
+    }
+
+    free(dphi);
+    free(pulse);
+    return n_wave;
+}
+
+void synth_gfsk(const uint8_t* symbols, int n_sym, float f0, float symbol_bt, float symbol_period, int signal_rate, float* signal)
+{
+    // Calculate and insert the audio waveform, using the output as the phase buffer
+    int n_wave = synth_gfsk_phase(symbols, n_sym, f0, symbol_bt, symbol_period, signal_rate, signal);
+    if (n_wave < 0)
+        return;
+    for (int k = 0; k < n_wave; ++k)
+    {
+        signal[k] = sinf(signal[k]);
+    }
+
+    // Apply envelope shaping to the first and last symbols
+    int n_spsym = n_wave / n_sym;
+    int n_ramp = n_spsym / 8;
+    for (int i = 0; i < n_ramp; ++i)
+    {
+        float env = (1 - cosf(2 * M_PI * i / (2 * n_ramp))) / 2;
+        signal[i] *= env;
+        signal[n_wave - 1 - i] *= env;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _INCLUDE_SYNTH_H_
+#define _INCLUDE_SYNTH_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FT8_SYMBOL_BT 2.0f ///< symbol smoothing filter bandwidth factor (BT)
+#define FT4_SYMBOL_BT 1.0f ///< symbol smoothing filter bandwidth factor (BT)
+
+    /// Computes a GFSK smoothing pulse.
+    /// The pulse is theoretically infinitely long, however, here it's truncated at 3 times the symbol length.
+    /// This means the pulse array has to have space for 3*n_spsym elements.
+    /// @param[in] n_spsym Number of samples per symbol
+    /// @param[in] symbol_bt Shape parameter (values defined for FT8/FT4)
+    /// @param[out] pulse Output array of pulse samples
+    void gfsk_pulse(int n_spsym, float symbol_bt, float* pulse);
+
+    /// Compute the phase of a GFSK waveform, sample by sample.
+    /// sinf(phase[k]) is the waveform (before the ramps at both ends), cosf(phase[k]) its quadrature.
+    /// @param[in] symbols Array of symbols (tones) (0-7 for FT8)
+    /// @param[in] n_sym Number of symbols in the symbol array
+    /// @param[in] f0 Audio frequency in Hertz for the symbol 0 (base frequency)
+    /// @param[in] symbol_bt Symbol smoothing filter bandwidth (2 for FT8, 1 for FT4)
+    /// @param[in] symbol_period Symbol period (duration), seconds
+    /// @param[in] signal_rate Sample rate of synthesized signal, Hertz
+    /// @param[out] phase Output array of phases in [0, 2 pi) (space for n_sym*n_spsym samples)
+    /// @return Number of samples written, or -1 if out of memory
+    int synth_gfsk_phase(const uint8_t* symbols, int n_sym, float f0, float symbol_bt, float symbol_period, int signal_rate, float* phase);
+
+    /// Synthesize waveform data using GFSK phase shaping.
+    /// The output waveform will contain n_sym symbols.
+    /// @param[in] symbols Array of symbols (tones) (0-7 for FT8)
+    /// @param[in] n_sym Number of symbols in the symbol array
+    /// @param[in] f0 Audio frequency in Hertz for the symbol 0 (base frequency)
+    /// @param[in] symbol_bt Symbol smoothing filter bandwidth (2 for FT8, 1 for FT4)
+    /// @param[in] symbol_period Symbol period (duration), seconds
+    /// @param[in] signal_rate Sample rate of synthesized signal, Hertz
+    /// @param[out] signal Output array of signal waveform samples (should have space for n_sym*n_spsym samples)
+    void synth_gfsk(const uint8_t* symbols, int n_sym, float f0, float symbol_bt, float symbol_period, int signal_rate, float* signal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _INCLUDE_SYNTH_H_
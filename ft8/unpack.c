@@ -5,6 +5,7 @@
 #endif
 
 #include "unpack.h"
+#include "hashcall.h"
 #include "text.h"
 
 #include <string.h>
@@ -13,6 +14,23 @@
 #define NTOKENS  ((uint32_t)2063592L)
 #define MAXGRID4 ((uint16_t)32400L)
 
+// Hashed callsign as "<K1ABC>" if it has been heard, "<...>" otherwise
+// result - at least 14 bytes
+static void hash_to_call(uint32_t hash, int bits, char* result)
+{
+    char callsign[12];
+    if (hashcall_lookup(hash, bits, callsign))
+    {
+        result[0] = '<';
+        strcpy(result + 1, callsign);
+        strcat(result, ">");
+    }
+    else
+    {
+        strcpy(result, "<...>");
+    }
+}
+
 // n28 is a 28-bit integer, e.g. n28a or n28b, containing all the
 // call sign bits from a packed message.
 int unpack_callsign(uint32_t n28, uint8_t ip, uint8_t i3, char* result)
@@ -64,12 +82,7 @@ int unpack_callsign(uint32_t n28, uint8_t ip, uint8_t i3, char* result)
     if (n28 < MAX22)
     {
         // This is a 22-bit hash of a result
-        // TODO: implement
-        strcpy(result, "<...>");
-        // result[0] = '<';
-        // int_to_dd(result + 1, n28, 7, false);
-        // result[8] = '>';
-        // result[9] = '\0';
+        hash_to_call(n28, 22, result);
         return 0;
     }
 
@@ -95,6 +108,9 @@ int unpack_callsign(uint32_t n28, uint8_t ip, uint8_t i3, char* result)
     if (strlen(result) == 0)
         return -1;
 
+    // Remember it for messages that carry only its hash (before any /R or /P suffix)
+    hashcall_save(result);
+
     // Check if we should append /R or /P suffix
     if (ip)
     {
@@ -142,14 +158,7 @@ int unpack_type1(const uint8_t* a77, uint8_t i3, char* call_to, char* call_de, c
         return -2;
     }
     // Fix "CQ_" to "CQ " -> already done in unpack_callsign()
-
-    // TODO: add to recent calls
-    // if (call_to[0] != '<' && strlen(call_to) >= 4) {
-    //     save_hash_call(call_to)
-    // }
-    // if (call_de[0] != '<' && strlen(call_de) >= 4) {
-    //     save_hash_call(call_de)
-    // }
+    // Standard callsigns were added to recent calls by unpack_callsign()
 
     char* dst = extra;
 
@@ -302,16 +311,11 @@ int unpack_nonstandard(const uint8_t* a77, char* call_to, char* call_de, char* e
     }
 
     char call_3[15];
-    // should replace with hash12(n12, call_3);
-    strcpy(call_3, "<...>");
-    // call_3[0] = '<';
-    // int_to_dd(call_3 + 1, n12, 4, false);
-    // call_3[5] = '>';
-    // call_3[6] = '\0';
+    hash_to_call(n12, 12, call_3);
 
     char* call_1 = (iflip) ? c11 : call_3;
     char* call_2 = (iflip) ? call_3 : c11;
-    //save_hash_call(c11_trimmed);
+    hashcall_save(trim_front(c11));
 
     if (icq == 0)
     {
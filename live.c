@@ -0,0 +1,298 @@
+// Live PCM input for decode_ft8, KA9Q-style
+// Reads continuous mono PCM (s16le or f32le) from stdin, a UNIX domain socket or a UDP (multicast) group,
+// cuts it into slots on UTC boundaries and decodes each slot from memory, with no files involved
+// The input is assumed to arrive in real time: sample times come from counting samples since the
+// stream started and are re-anchored to the system clock if they drift by more than a second (gaps, overruns)
+
+#define _GNU_SOURCE 1
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "decode_ft8.h"
+
+extern int Verbose;
+
+#define MAX_DRIFT (1.0) // Seconds between sample clock and system clock before we re-anchor
+#define MAX_LATE (1.0) // A slot may begin this late (e.g., first packet after the boundary); DT absorbs it
+
+// A slot being filled or decoded
+struct slot {
+  ft8_decoder_t dec;
+  struct tm tm;   // UTC @ first sample, whole seconds
+  double fsec;    // and fraction
+  bool full;      // Handed to the decoder thread
+};
+
+// Slots are double buffered: one fills while the decoder thread works on the other
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  struct slot slots[2];
+  double base_freq;
+} Live = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .changed = PTHREAD_COND_INITIALIZER,
+};
+
+static void *live_decoder(void *arg){
+  (void)arg;
+  for(int next = 0; ; next ^= 1){
+    struct slot *sp = &Live.slots[next];
+    pthread_mutex_lock(&Live.lock);
+    while(!sp->full)
+      pthread_cond_wait(&Live.changed,&Live.lock);
+    pthread_mutex_unlock(&Live.lock);
+
+    decoder_decode(&sp->dec);
+    decoder_print(&sp->dec, Live.base_freq, &sp->tm, sp->fsec);
+
+    pthread_mutex_lock(&Live.lock);
+    sp->full = false;
+    pthread_cond_broadcast(&Live.changed);
+    pthread_mutex_unlock(&Live.lock);
+  }
+  return NULL;
+}
+
+static double realtime_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME,&ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Open the input: "-" = stdin, "unix:/path" = listen on a UNIX stream socket,
+// "udp:[group:]port" = receive datagrams, joining the group if it's multicast
+// For a UNIX socket *listener is set and the caller must accept() connections on it
+static int open_source(char const *source, int *listener){
+  *listener = -1;
+  if(strcmp(source,"-") == 0)
+    return STDIN_FILENO;
+
+  if(strncmp(source,"unix:",5) == 0){
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+    if(strlen(source + 5) >= sizeof sun.sun_path){
+      fprintf(stderr,"%s: socket path too long\n",source);
+      return -1;
+    }
+    strcpy(sun.sun_path,source + 5);
+    int const fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd == -1){
+      fprintf(stderr,"socket(%s): %s\n",source,strerror(errno));
+      return -1;
+    }
+    unlink(sun.sun_path); // Left over from an earlier run
+    if(bind(fd,(struct sockaddr *)&sun,sizeof sun) != 0 || listen(fd,1) != 0){
+      fprintf(stderr,"bind/listen %s: %s\n",source,strerror(errno));
+      close(fd);
+      return -1;
+    }
+    *listener = fd;
+    return -1;
+  }
+  if(strncmp(source,"udp:",4) == 0){
+    char *spec = strdup(source + 4);
+    char *group = NULL;
+    char *port = spec;
+    char *cp = strrchr(spec,':');
+    if(cp != NULL){
+      *cp = '\0';
+      group = spec;
+      port = cp + 1;
+    }
+    struct sockaddr_in sin = {
+      .sin_family = AF_INET,
+      .sin_port = htons(strtol(port,NULL,0)),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct in_addr group_addr = { .s_addr = htonl(INADDR_ANY) };
+    if(group != NULL && strlen(group) > 0 && inet_pton(AF_INET,group,&group_addr) != 1){
+      fprintf(stderr,"%s: bad IPv4 address %s\n",source,group);
+      free(spec);
+      return -1;
+    }
+    free(spec);
+    int const fd = socket(AF_INET,SOCK_DGRAM,0);
+    if(fd == -1){
+      fprintf(stderr,"socket(%s): %s\n",source,strerror(errno));
+      return -1;
+    }
+    int const one = 1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof one); // Let several decoders share a group
+    int const bufsize = 1 << 20; // Ride out decoder hiccups
+    setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&bufsize,sizeof bufsize);
+    if(IN_MULTICAST(ntohl(group_addr.s_addr)))
+      sin.sin_addr = group_addr; // Receive only that group's traffic on this port
+    if(bind(fd,(struct sockaddr *)&sin,sizeof sin) != 0){
+      fprintf(stderr,"bind %s: %s\n",source,strerror(errno));
+      close(fd);
+      return -1;
+    }
+    if(IN_MULTICAST(ntohl(group_addr.s_addr))){
+      struct ip_mreq mreq = {
+	.imr_multiaddr = group_addr,
+	.imr_interface.s_addr = htonl(INADDR_ANY),
+      };
+      if(setsockopt(fd,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,sizeof mreq) != 0){
+	fprintf(stderr,"join %s: %s\n",source,strerror(errno));
+	close(fd);
+	return -1;
+      }
+    }
+    return fd;
+  }
+  fprintf(stderr,"Unknown live source %s; use -, unix:/path or udp:[group:]port\n",source);
+  return -1;
+}
+
+// Decode continuous PCM from 'source' until it ends (stdin) or forever (sockets)
+int process_live(char const *source, bool is_ft8, double base_freq, int sample_rate, bool is_float){
+  if(source == NULL || sample_rate <= 0)
+    return -1;
+
+  int listener = -1;
+  int fd = open_source(source,&listener);
+  if(fd == -1 && listener == -1)
+    return -1;
+
+  Live.base_freq = base_freq;
+  for(int i = 0; i < 2; i++){
+    if(!decoder_init(&Live.slots[i].dec, sample_rate, is_ft8)){
+      fprintf(stderr,"Can't allocate decoder for %d Hz\n",sample_rate);
+      return -1;
+    }
+  }
+  pthread_t tid;
+  if(pthread_create(&tid,NULL,live_decoder,NULL) != 0){
+    fprintf(stderr,"Can't start decoder thread: %s\n",strerror(errno));
+    return -1;
+  }
+  double const slot_time = is_ft8 ? FT8_SLOT_TIME : FT4_SLOT_TIME;
+  int const sample_bytes = is_float ? sizeof(float) : sizeof(int16_t);
+
+  struct slot *cur = NULL;  // Slot being filled, NULL between slots
+  int cur_index = 0;
+  double t0 = 0;            // System time of sample 0
+  int64_t sample_count = 0; // Samples since t0
+  bool anchored = false;
+  // Samples are decoded in place, so the buffer is aligned for either format
+  union {
+    uint8_t bytes[65536];
+    int16_t s16[65536 / sizeof(int16_t)];
+    float f32[65536 / sizeof(float)];
+  } buffer;
+  size_t have = 0;          // Bytes in buffer, possibly ending with part of a sample
+
+  while(true){
+    if(fd == -1){
+      // Wait for a sender to connect to our UNIX socket
+      fd = accept(listener,NULL,NULL);
+      if(fd == -1){
+	fprintf(stderr,"accept %s: %s\n",source,strerror(errno));
+	break;
+      }
+      if(Verbose)
+	fprintf(stderr,"%s: sender connected\n",source);
+      have = 0;
+      anchored = false; // New stream, new clock
+    }
+    ssize_t const n = read(fd, buffer.bytes + have, sizeof buffer - have);
+    if(n <= 0){
+      if(n < 0 && errno == EINTR)
+	continue;
+      if(listener == -1)
+	break; // stdin or socket error: done
+      close(fd); // Sender went away; wait for another
+      fd = -1;
+      continue;
+    }
+    double const now = realtime_seconds();
+    have += n;
+    int const count = have / sample_bytes;
+
+    // The last sample just read arrived now
+    double const t_est = t0 + (double)(sample_count + count) / sample_rate;
+    if(!anchored || fabs(t_est - now) > MAX_DRIFT){
+      if(anchored)
+	fprintf(stderr,"%s: sample clock off by %.2f sec, resynchronizing\n",source,t_est - now);
+      t0 = now - (double)count / sample_rate;
+      sample_count = 0;
+      anchored = true;
+      cur = NULL; // Can't trust the slot in progress; pick up at the next boundary
+    }
+    for(int i = 0; i < count; ){
+      double const t = t0 + (double)(sample_count + i) / sample_rate; // Time of samples[i]
+      if(cur == NULL){
+	// Start now if we're just past a slot boundary, otherwise skip to the next one
+	double start = floor(t / slot_time) * slot_time;
+	if(t - start > MAX_LATE)
+	  start += slot_time;
+	int const skip = start > t ? (int)ceil((start - t) * sample_rate - 1e-6) : 0;
+	if(i + skip >= count)
+	  break;
+	i += skip;
+	double const t_start = t0 + (double)(sample_count + i) / sample_rate;
+	cur = &Live.slots[cur_index];
+	// Wait for the decoder thread if it's still busy with this one from two slots ago
+	pthread_mutex_lock(&Live.lock);
+	while(cur->full)
+	  pthread_cond_wait(&Live.changed,&Live.lock);
+	pthread_mutex_unlock(&Live.lock);
+	decoder_reset(&cur->dec);
+	time_t tt = (time_t)floor(t_start);
+	cur->fsec = t_start - tt;
+	if(cur->fsec > 0.5){
+	  // Round up, like the file decoder
+	  tt++;
+	  cur->fsec -= 1.0;
+	}
+	gmtime_r(&tt,&cur->tm);
+      }
+      if(is_float)
+	i += decoder_feed(&cur->dec, buffer.f32 + i, count - i);
+      else
+	i += decoder_feed_s16(&cur->dec, buffer.s16 + i, count - i);
+      if(decoder_full(&cur->dec)){
+	// Waterfall is complete; the rest of the slot isn't needed
+	pthread_mutex_lock(&Live.lock);
+	cur->full = true;
+	pthread_cond_broadcast(&Live.changed);
+	pthread_mutex_unlock(&Live.lock);
+	cur = NULL;
+	cur_index ^= 1;
+      }
+    }
+    sample_count += count;
+    // Keep any partial sample for the next read
+    have -= count * sample_bytes;
+    memmove(buffer.bytes, buffer.bytes + count * sample_bytes, have);
+  }
+  // Input ended. Decode a partial slot only if it holds enough to be worth it
+  if(cur != NULL && decoder_seconds(&cur->dec) >= (is_ft8 ? 12.64 : 4.48)){
+    pthread_mutex_lock(&Live.lock);
+    cur->full = true;
+    pthread_cond_broadcast(&Live.changed);
+    pthread_mutex_unlock(&Live.lock);
+  }
+  // Let the decoder thread finish whatever it has
+  pthread_mutex_lock(&Live.lock);
+  while(Live.slots[0].full || Live.slots[1].full)
+    pthread_cond_wait(&Live.changed,&Live.lock);
+  pthread_mutex_unlock(&Live.lock);
+  if(listener != -1)
+    close(listener);
+  return 0;
+}
@@ -1,6 +1,20 @@
 // unknown origin; hacked by Phil Karn, KA9Q Oct 2023
 // Written by KA9Q May/June 2025 to process a hierarchy of spool directories
-// decode_ft8 [-v] [-4] [-f megahertz] file_or_directory
+// decode_ft8 [-v] [-4] [-f megahertz] [-t threads] [-j workers] [-F kiss|fftw] [-S] [-L] [-O depth [-B budget]] [-m passes] [-b low-high] [-D low-high ...] [-H hashfile] [-s [-e seconds]] [-l [-P s16|f32] [-R rate]] file_or_directory_or_source
+// With -S, the sync search scores a coarse grid first and refines only around the best points (faster, wideband)
+// With -L, LDPC decoding uses the layered min-sum decoder rather than flooding belief propagation
+// With -O 1 or 2, candidates that BP nearly decoded get an ordered statistics decode, at most -B per slot (default 100)
+// With -m, up to that many decoding passes per slot: each subtracts the signals already decoded and searches again
+// With -b low-high, only that audio band (Hz) is analysed and searched, e.g. -b 200-3000 for the usual FT8 sub-band
+// With -D low-high (repeatable, each at most 5.6 kHz wide), a wideband file is instead split into those sub-bands
+// by a fast convolution filter bank, each decimated to 12 kHz and decoded in parallel (files and spool directories only)
+// With -H file, the callsigns heard (for resolving <...> hashed callsigns in later messages) are kept in that
+// memory-mapped file, so a restarted daemon still knows them
+// With -j, a pool of worker threads decodes spool files in parallel, preserving order within each band
+// With -s, decodes one slot from a pipe, FIFO or file still being written ("-" = stdin) as it arrives,
+// printing early decodes once -e seconds are in (default 12.6 for FT8, 5.4 for FT4; 0 = off) and the rest at the end
+// With -l, the argument is a live PCM source instead: - (stdin), unix:/path or udp:[group:]port
+// carrying mono s16le or f32le (-P s16|f32) at -R Hz (default 12000), decoded slot by slot (see live.c)
 // If given a file, decodes just that file
 // If given a directory, scans and processes every file in that directory
 // Uses inotify() on linux, otherwise just polls
@@ -28,12 +42,16 @@
 #include <sys/xattr.h>
 #include <limits.h>
 #include <sys/file.h>
+#include <pthread.h>
 #ifdef __linux__
 #include <sys/inotify.h>
 #endif
 
 #include "common/wave.h"
 #include "common/debug.h"
+#include "common/rfft.h"
+#include "ft8/hashcall.h"
+#include "decode_ft8.h"
 
 #define LOG_LEVEL LOG_FATAL
 
@@ -49,6 +67,14 @@ int Verbose = 0;
 bool NoDelete; // Don't delete input file after decoding
 bool Run_queue = false; // When true, exit after running queue (suitable for calling from cron)
 #define SORT_SIZE (8192) // Max size of file name sort list
+#define QUEUE_SIZE (1024) // Max files waiting for a decode worker
+int Workers = 0; // Spool decode worker threads (-j); 0 = decode in the watcher thread
+bool Stream = false; // Decode a single slot as it's being written (-s)
+double Early_decode = -1; // Seconds of signal before the early decode pass in stream mode (-e); < 0 = protocol default
+#define STREAM_IDLE (2.0) // Seconds a file being written may stop growing before we call it finished
+bool Live_input = false; // Argument is a live PCM source (-l)
+bool Live_float = false; // Live samples are f32le rather than s16le (-P)
+int Live_rate = 12000; // Live sample rate (-R)
 
 #define HSIZE 127
 struct wd_hashtab {
@@ -58,7 +84,14 @@ struct wd_hashtab {
 
 static int has_suffix(const char *filename, const char *suffix);
 int process_file(char const *path,bool is_ft8,double base_freq); // Either file or directory (calls recursively)
+int process_stream(char const *path,bool is_ft8,double base_freq); // Decode while it's being written
+int process_live(char const *source, bool is_ft8, double base_freq, int sample_rate, bool is_float); // live.c
+double file_base_freq(char const *path);
+bool file_start_time(char const *path, struct tm *tmp, double *fsec);
 void process_directory(char const *path, bool is_ft8, double base_freq); // Directory only; called recursively
+void submit_file(char const *path, bool is_ft8, double base_freq); // Queue for a worker, or process now
+void start_workers(void);
+void drain_queue(void);
 int add_watches_recursive(int fd, const char *path);
 int scompare(void const *a, void const *b);
 void usage();
@@ -74,7 +107,7 @@ int main(int argc, char *argv[]){
   // ffffffffff is frequency in *hertz*
   double base_freq = 0;
   int c;
-  while((c = getopt(argc,argv,"48f:vnr")) != -1){
+  while((c = getopt(argc,argv,"48f:vnrt:j:F:se:lP:R:SLO:B:m:b:D:H:")) != -1){
     switch(c){
     case 'r':
       Run_queue = true;
@@ -84,6 +117,7 @@ int main(int argc, char *argv[]){
       break;
     case 'v':
       Verbose++;
+      Decode_stats = true;
       break;
     case '8':
       is_ft8 = true; // In case it's not the default
@@ -94,6 +128,87 @@ int main(int argc, char *argv[]){
     case 'f': // Base frequency in Megahertz, otherwise extracted from file name
       base_freq = strtod(optarg,NULL);
       break;
+    case 'j': // Decode up to this many spool files at once
+      Workers = strtol(optarg,NULL,0);
+      if(Workers <= 0)
+	Workers = sysconf(_SC_NPROCESSORS_ONLN);
+      break;
+    case 'F': // FFT implementation
+      if(!rfft_parse_backend(optarg,&Rfft_default_backend)){
+	fprintf(stderr,"Unknown or unavailable FFT backend %s, using %s\n",optarg,rfft_backend_name(Rfft_default_backend));
+      }
+      break;
+    case 's': // Stream: decode a pipe, FIFO or growing file as it's written
+      Stream = true;
+      break;
+    case 'e': // Early decode time in stream mode
+      Early_decode = strtod(optarg,NULL);
+      break;
+    case 'l': // Live PCM from stdin or a socket
+      Live_input = true;
+      break;
+    case 'P': // Live sample format
+      if(strcmp(optarg,"s16") == 0)
+	Live_float = false;
+      else if(strcmp(optarg,"f32") == 0)
+	Live_float = true;
+      else
+	fprintf(stderr,"Unknown sample format %s, using %s\n",optarg,Live_float ? "f32" : "s16");
+      break;
+    case 'R': // Live sample rate
+      Live_rate = strtol(optarg,NULL,0);
+      break;
+    case 'S': // Coarse-to-fine sync search: faster on wide bandwidths, may miss weak signals
+      Coarse_sync = true;
+      break;
+    case 'L': // Layered min-sum LDPC decoder: fewer iterations, different (mostly more) decodes
+      Ldpc_layered = true;
+      break;
+    case 'O': // Ordered statistics decoding depth (1 or 2) for candidates BP almost decoded
+      Osd_depth = strtol(optarg,NULL,0);
+      break;
+    case 'B': // OSD attempts per slot
+      Osd_budget = strtol(optarg,NULL,0);
+      break;
+    case 'm': // Decoding passes with signal subtraction
+      Decode_passes = strtol(optarg,NULL,0);
+      if(Decode_passes < 1)
+	Decode_passes = 1;
+      break;
+    case 'b': // Audio band to analyse, low-high in Hz
+      {
+	char *end = NULL;
+	Freq_min = strtod(optarg,&end);
+	Freq_max = (*end == '-') ? strtod(end + 1,NULL) : 0;
+	if(Freq_min < 0 || (Freq_max != 0 && Freq_max <= Freq_min)){
+	  fprintf(stderr,"Bad band %s, analysing the whole band\n",optarg);
+	  Freq_min = Freq_max = 0;
+	}
+      }
+      break;
+    case 'D': // Sub-band to down-convert to 12 kHz and decode, low-high in Hz; may be repeated
+      {
+	char *end = NULL;
+	band_t const band = { .low = strtod(optarg,&end), .high = (*end == '-') ? strtod(end + 1,NULL) : 0 };
+	if(band.low < 0 || band.high <= band.low)
+	  fprintf(stderr,"Bad sub-band %s, ignored\n",optarg);
+	else if(Num_ddc_bands == MAX_DDC_BANDS)
+	  fprintf(stderr,"Too many sub-bands, %s ignored\n",optarg);
+	else
+	  Ddc_bands[Num_ddc_bands++] = band;
+      }
+      break;
+    case 'H': // Keep the callsigns heard, for resolving hashed ones, in this file across restarts
+      if(!hashcall_open(optarg))
+	fprintf(stderr,"Can't map callsign hash file %s: %s\n",optarg,strerror(errno));
+      break;
+    case 't': // Sync search and candidate decoding threads; 0 = one per online CPU
+      Decode_threads = strtol(optarg,NULL,0);
+      if(Decode_threads <= 0)
+	Decode_threads = sysconf(_SC_NPROCESSORS_ONLN);
+      if(Decode_threads <= 0)
+	Decode_threads = 1;
+      break;
     }
   }
   {
@@ -105,6 +220,10 @@ int main(int argc, char *argv[]){
     exit(1);
   }
   path = argv[optind];
+  if(Live_input)
+    exit(process_live(path, is_ft8, base_freq, Live_rate, Live_float));
+  if(Stream)
+    exit(process_stream(path, is_ft8, base_freq));
   {
     struct stat statbuf;
     if(lstat(path,&statbuf) == -1){
@@ -122,6 +241,7 @@ int main(int argc, char *argv[]){
       exit(1);
     }
   }
+  start_workers();
 #ifdef __linux__ // inotify is linux-only; non-linux will run simple timer-based directory scan below
   extern int Watches;
 
@@ -157,8 +277,10 @@ int main(int argc, char *argv[]){
       poll_interval = 1 + (random() & 31); // 1-32 seconds inclusive
       process_directory(path, is_ft8, base_freq);
       last_poll = now;
-      if(Run_queue)
+      if(Run_queue){
+	drain_queue();
 	exit(0);
+      }
     }
     // Don't block on the inotify read indefinitely
     struct pollfd pd = {
@@ -250,7 +372,7 @@ int main(int argc, char *argv[]){
 	    if(filecount < SORT_SIZE)
 	      file_list[filecount++] = strdup(fullname); // mallocs memory, freed after sort and process
 	    else
-	      process_file(fullname, is_ft8, base_freq); // sort table is full (unlikely) so just process it
+	      submit_file(fullname, is_ft8, base_freq); // sort table is full (unlikely) so just process it
 	  }
 	  break;
 	case S_IFDIR:
@@ -269,7 +391,7 @@ int main(int argc, char *argv[]){
       // and I'd rather not delay artificially
       qsort(file_list,filecount,sizeof file_list[0],scompare);
       for(int i=0; i < filecount; i++){
-	process_file(file_list[i], is_ft8, base_freq);
+	submit_file(file_list[i], is_ft8, base_freq);
 	free(file_list[i]);
       }
     }
@@ -286,8 +408,10 @@ int main(int argc, char *argv[]){
     // Re-scan the directory every 1-8 seconds
     // Will happen on the first loop since last_poll is in the distant past
     process_directory(path, is_ft8, base_freq);
-    if(Run_queue)
+    if(Run_queue){
+      drain_queue();
       break;
+    }
     sleep(1 + (random() & 7)); // Random sleep between 1 and 8 sec; prevent synchronizing of multiple workers
   }
 #endif
@@ -479,20 +603,20 @@ int process_file(char const * const path, bool is_ft8, double base_freq){
     return 1;
   }
 
-  int sample_rate = 0; // These get overwritten by load_wav
-  int num_samples = 0;
-  int num_channels = 0;
-  float *signal = NULL; // now allocated by load_wav, must free if we ever loop
-
-  // load_wav now allocates signal, we must free (unless we exit right away, as we currently do)
+  // Map the file rather than reading it into memory; the samples are converted a block at a time as
+  // the decoder takes them. Keep it locked until we're done so nobody truncates it under the mapping
   assert(path != NULL);
-  int const rc = load_wav(&signal, &num_samples, &num_channels, &sample_rate, path, fd);
-  flock(fd,LOCK_UN);
-  close(fd); // remove the lock file later, after possible file removal
+  wav_reader_t wav;
+  int const rc = wav_open(&wav, fd, path);
+  int const num_samples = wav.num_frames;
+  int const sample_rate = wav.sample_rate;
   if(Verbose)
     fprintf(stderr,"decode %s: %d samples, sample rate %d Hz\n", path, num_samples, sample_rate);
 
   if (rc < 0 || num_samples < (is_ft8 ? 12.64 : 4.48 ) * sample_rate){
+    wav_close(&wav);
+    flock(fd,LOCK_UN);
+    close(fd);
     struct stat statbuf = {0};
     if(lstat(path,&statbuf) == 0){
       struct timespec ts = {0};
@@ -525,87 +649,16 @@ int process_file(char const * const path, bool is_ft8, double base_freq){
     }
     return -1;
   }
-  if(base_freq == 0){
-    assert(path != NULL);
-    // Look first for extended file attribute "user.frequency" (linux) or "frequency" (macos)
-    char att_buffer[1024] = {0}; // Shouldn't be anywhere near this long
-#ifdef __linux__
-    ssize_t s = getxattr(path,"user.frequency",att_buffer,sizeof(att_buffer) - 1);
-#else
-    ssize_t s = getxattr(path,"frequency",att_buffer,sizeof(att_buffer) - 1,0,0);
-#endif
-    if(s > 0){
-      // Extract from attribute
-      base_freq = strtod(att_buffer,NULL);
-      base_freq /= 1e6; // Hz -> MHz
-      if(Verbose > 1)
-	fprintf(stderr,"Extracted base frequency %lf MHz from attribute\n",base_freq);
-    } else {
-      // Extract from file name
-      char *cp,*cp1;
-      // Should use basename in case directory element has _
-      if((cp = strchr(path,'_')) != NULL && (cp1 = strrchr(path,'_')) != NULL){
-	base_freq = strtod(cp+1,NULL) / 1e6;
-	if(Verbose > 1)
-	  fprintf(stderr,"Extracted base frequency %lf MHz from file name\n",base_freq);
-      }
-    }
-  }
+  if(base_freq == 0)
+    base_freq = file_base_freq(path);
   if(base_freq == 0)
     fprintf(stderr,"Unknown base frequency for %s\n",path);
 
   struct tm tmp = {0};
   double fsec = 0; // Fractional second
-  bool tmp_set = false;
-  {
-    // Look first for extended file attribute "user.unixstarttime" or "unixstarttime"
-    char att_buffer[1024] = {0};
-#ifdef __linux__
-    ssize_t s = getxattr(path,"user.unixstarttime",att_buffer,sizeof(att_buffer) - 1);
-#else
-    ssize_t s = getxattr(path,"unixstarttime",att_buffer,sizeof(att_buffer) - 1,0,0);
-#endif
-    if(s > 0){
-      // Extract from attribute
-      double t = strtod(att_buffer,NULL);
-      time_t tt = t;
-      fsec = fmod(t,1.0);
-      if(round(t) != floor(t)){
-	// Round up to nearest second, otherwise round down
-	tt++;
-	fsec -= 1.0;
-      }
-      if(gmtime_r(&tt,&tmp) != NULL){
-	tmp_set = true;
-	if(Verbose > 1)
-	  fprintf(stderr,"Time extracted from attribute\n");
-      }
-    }
-  }
+  bool tmp_set = file_start_time(path,&tmp,&fsec);
   if(!tmp_set){
-    // that didn't work, try extracting date-time from file name
-      char *npath = strdup(path);
-      char const *bn = basename(npath);
-      int year,mon,day,hr,minute,sec;
-      char junk;
-      int r = sscanf(bn,"%04d%02d%02d%c%02d%02d%02d",&year,&mon,&day,&junk,&hr,&minute,&sec);
-      free(npath);
-      if(r == 7){
-	// Convert to Unix-style struct tm (using its conventions)
-	tmp.tm_year = year - 1900;
-	tmp.tm_mon = mon - 1;
-	tmp.tm_mday = day;
-	tmp.tm_hour = hr;
-	tmp.tm_min = minute;
-	tmp.tm_sec = sec;
-	fsec = 0; // Not available
-	tmp_set = true;
-	if(Verbose > 1)
-	  fprintf(stderr,"Time extracted from filename\n");
-      }
-  }
-  if(!tmp_set){
-    // That didn't work either, so subtract 7.5 or 15 sec from the modification time
+    // Neither the attributes nor the file name have it, so subtract 7.5 or 15 sec from the modification time
     // not really tested, but seems simple enough
     struct stat statbuf = {0};
     if(lstat(path,&statbuf) == 0){
@@ -643,9 +696,10 @@ int process_file(char const * const path, bool is_ft8, double base_freq){
     fprintf(stderr,"%s: recording time unknown\n",path);
 
   // Do the actual decoding.
-  process_buffer(signal, sample_rate, num_samples, is_ft8, base_freq, &tmp,fsec);
-  free(signal); // allocated by load_wav
-  signal = NULL;
+  process_wav(&wav, is_ft8, base_freq, &tmp,fsec);
+  wav_close(&wav);
+  flock(fd,LOCK_UN);
+  close(fd); // remove the lock file later, after possible file removal
   fflush(stdout);
 
   // Done with the file (could have been deleted earlier, but just in case we crash)
@@ -661,6 +715,133 @@ int process_file(char const * const path, bool is_ft8, double base_freq){
   }
   return 0;
 }
+static double monotonic_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Decode a single slot from a pipe, FIFO or a file that's still being written, path "-" = stdin
+// The waterfall is filled as the audio arrives. Once Early_decode seconds of it are in we search and
+// decode what we have and print it right away; the rest is printed after a final pass at the end of the slot
+// Stream files are neither locked nor deleted
+int process_stream(char const * const path, bool is_ft8, double base_freq){
+  if(path == NULL || strlen(path) == 0)
+    return -1;
+
+  bool const is_stdin = (strcmp(path,"-") == 0);
+  FILE *f = is_stdin ? stdin : fopen(path,"rb"); // Opening a FIFO blocks until the writer shows up
+  if(f == NULL){
+    fprintf(stderr,"Can't open %s: %s\n",path,strerror(errno));
+    return 1;
+  }
+  struct stat statbuf = {0};
+  bool const growing = fstat(fileno(f),&statbuf) == 0 && (statbuf.st_mode & S_IFMT) == S_IFREG;
+  if(growing){
+    // The writer may not have finished the header yet; wait for it and a little data
+    double const start = monotonic_seconds();
+    while(statbuf.st_size < 512 && monotonic_seconds() - start < STREAM_IDLE){
+      usleep(50000);
+      fstat(fileno(f),&statbuf);
+    }
+  }
+  int sample_rate = 0;
+  int num_channels = 0;
+  int audio_format = 0;
+  int bits_per_sample = 0;
+  uint32_t data_size = 0;
+  if(read_wav_header(f, path, &sample_rate, &num_channels, &audio_format, &bits_per_sample, &data_size) != 0){
+    if(!is_stdin)
+      fclose(f);
+    return -1;
+  }
+  if(num_channels != 1 || !((audio_format == 1 && bits_per_sample == 16) || (audio_format == 3 && bits_per_sample == 32))){
+    fprintf(stderr,"%s: need one channel of 16-bit PCM or 32-bit float, not %d channels of format %d, %d bits\n",
+	    path,num_channels,audio_format,bits_per_sample);
+    if(!is_stdin)
+      fclose(f);
+    return -1;
+  }
+  if(base_freq == 0 && !is_stdin)
+    base_freq = file_base_freq(path);
+  if(base_freq == 0)
+    fprintf(stderr,"Unknown base frequency for %s\n",path);
+
+  struct tm tmp = {0};
+  double fsec = 0;
+  if(is_stdin || !file_start_time(path,&tmp,&fsec)){
+    // Nothing better available, so assume the first sample is arriving now
+    struct timespec ts = {0};
+    timespec_get(&ts,TIME_UTC);
+    time_t tt = ts.tv_sec;
+    fsec = ts.tv_nsec * 1.0e-9;
+    if(ts.tv_nsec > 500000000){
+      // Round up
+      tt++;
+      fsec -= 1.0;
+    }
+    gmtime_r(&tt,&tmp);
+  }
+  ft8_decoder_t *dec = decoder_get(sample_rate, is_ft8);
+  if(dec == NULL){
+    if(!is_stdin)
+      fclose(f);
+    return -1;
+  }
+  double const early = Early_decode >= 0 ? Early_decode : (is_ft8 ? 12.6 : 5.4);
+  bool early_done = (early <= 0);
+  int const sample_bytes = bits_per_sample / 8;
+  uint64_t remaining = (data_size == 0xffffffff) ? UINT64_MAX : data_size;
+  uint8_t buffer[8192];
+  float samples[sizeof buffer / sizeof(int16_t)];
+  size_t have = 0; // Bytes in buffer, possibly ending with part of a sample
+  double last_data = monotonic_seconds();
+
+  while(!decoder_full(dec) && remaining > 0){
+    size_t want = sizeof buffer - have;
+    if(want > remaining)
+      want = remaining;
+    size_t const n = fread(buffer + have, 1, want, f);
+    if(n == 0){
+      // A pipe or FIFO is done when the writer closes it; a file when it stops growing for a while
+      if(ferror(f) || !growing || monotonic_seconds() - last_data > STREAM_IDLE)
+	break;
+      clearerr(f);
+      usleep(20000);
+      continue;
+    }
+    last_data = monotonic_seconds();
+    remaining -= n;
+    have += n;
+    int const count = have / sample_bytes;
+    if(audio_format == 1){
+      int16_t const *ip = (int16_t const *)buffer;
+      for(int i = 0; i < count; i++)
+	samples[i] = ip[i] / 32768.0f;
+    } else
+      memcpy(samples, buffer, count * sizeof(float));
+
+    decoder_feed(dec, samples, count);
+    have -= count * sample_bytes;
+    memmove(buffer, buffer + count * sample_bytes, have);
+
+    if(!early_done && !decoder_full(dec) && decoder_seconds(dec) >= early){
+      early_done = true;
+      int const r = decoder_decode(dec);
+      if(Verbose)
+	fprintf(stderr,"%s: early pass at %.2f sec, %d decodes\n",path,decoder_seconds(dec),r);
+      decoder_print(dec, base_freq, &tmp, fsec);
+    }
+  }
+  if(!is_stdin)
+    fclose(f);
+
+  int const r = decoder_decode(dec);
+  if(Verbose)
+    fprintf(stderr,"%s: final pass at %.2f sec, %d new decodes\n",path,decoder_seconds(dec),r);
+  decoder_print(dec, base_freq, &tmp, fsec);
+  return 0;
+}
 // Returns 1 if filename ends with suffix (e.g., ".job"), else 0
 static int has_suffix(const char *filename, const char *suffix) {
   if(filename == NULL || suffix == NULL)
@@ -686,33 +867,15 @@ void process_directory(char const *path, bool is_ft8, double base_freq){
   if(path == NULL)
     path = "."; // Default to current directory
 
-  int cwd_fd = -1;
-  int dir_fd = -1;
-  DIR *dirp = NULL;
-
   if(Verbose > 1)
     fprintf(stderr,"processing directory %s\n",path);
 
-  cwd_fd = open(".", O_RDONLY|O_DIRECTORY);
-  if(cwd_fd == -1)
-    fprintf(stderr,"Can't read current directory: %s\n",strerror(errno));
-
-  // chdir into the specified directory and work from there as
-  // dirent entries will be interpreted relative to the current directory
-  // But we must pop back before returning
-  dir_fd = open(path,O_RDONLY|O_DIRECTORY);
-  if(dir_fd == -1){
-    fprintf(stderr,"Can't open directory %s: %s\n",path,strerror(errno));
-    goto done;
-  }
-  if(fchdir(dir_fd) != 0){
-    fprintf(stderr,"Can't change into directory %s: %s\n",path,strerror(errno));
-    goto done;
-  }
-  dirp = fdopendir(dir_fd);
+  // Build full path names rather than chdir'ing into the directory, since
+  // decode workers may be opening files relative to the current directory at the same time
+  DIR *dirp = opendir(path);
   if(dirp == NULL){
     fprintf(stderr,"Can't scan directory %s: %s\n",path,strerror(errno));
-    goto done;
+    return;
   }
   // Sort entries from oldest to newest
   // If there are more than SORT_SIZE files, we'll get them next time
@@ -725,43 +888,257 @@ void process_directory(char const *path, bool is_ft8, double base_freq){
     // ignore directories "." and ".." or we'd recurse forever
     switch(d->d_type){
     case DT_DIR:
-      if(strcmp(d->d_name,".") != 0 && strcmp(d->d_name,"..") != 0)
-	process_directory(d->d_name, is_ft8, base_freq); // Recursive call
+      if(strcmp(d->d_name,".") != 0 && strcmp(d->d_name,"..") != 0){
+	char *subdir = NULL;
+	if(asprintf(&subdir,"%s/%s",path,d->d_name) > 0)
+	  process_directory(subdir, is_ft8, base_freq); // Recursive call
+	free(subdir);
+      }
       break;
     case DT_REG:
-      if(has_suffix(d->d_name,".wav") && filecount < SORT_SIZE)
-	file_list[filecount++] = strdup(d->d_name); // d_name changes when readdir is called again
+      if(has_suffix(d->d_name,".wav") && filecount < SORT_SIZE){
+	char *fullname = NULL;
+	if(asprintf(&fullname,"%s/%s",path,d->d_name) > 0) // d_name changes when readdir is called again
+	  file_list[filecount++] = fullname;
+	else
+	  free(fullname);
+      }
       break;
     default:
       break;
     }
   }
   closedir(dirp);
-  dir_fd = -1; // closedir does this
-  dirp = NULL;
   qsort(file_list,filecount,sizeof file_list[0],scompare);
   for(int i=0; i < filecount; i++){
-    process_file(file_list[i], is_ft8, base_freq);
+    submit_file(file_list[i], is_ft8, base_freq);
     free(file_list[i]);
   }
-  // Return to our originally scheduled program
-done:;
-  if(cwd_fd != -1){
-    if(fchdir(cwd_fd) == -1) // Change back if necessary
-      fprintf(stderr,"Can't change into current directory: %s\n",strerror(errno));
-    close(cwd_fd);
+}
+
+// Spool worker pool (-j)
+// The watcher (main thread) queues files and the workers decode them. Files from the same band
+// (same directory and same name after the timestamp, e.g. _14074000_usb.wav) are decoded one at a time
+// in the order they were queued, so a band's output stays in time order while different bands run in parallel
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // Signaled whenever the queue or the busy list changes
+  struct job {
+    char *path;
+    char *band;
+    bool is_ft8;
+    double base_freq;
+  } queue[QUEUE_SIZE];
+  int count;   // Jobs waiting in queue[]
+  char **busy; // Band key of the job each worker is decoding, NULL when idle
+  char **busy_path;
+} Pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .changed = PTHREAD_COND_INITIALIZER,
+};
+
+// Files with the same key must be decoded in order
+static char *band_key(char const *path){
+  char const *base = strrchr(path,'/');
+  base = base ? base + 1 : path;
+  char const *suffix = strchr(base,'_');
+  if(suffix == NULL)
+    suffix = ""; // No frequency in the name, treat the whole directory as one band
+  char *key = NULL;
+  if(asprintf(&key,"%.*s%s",(int)(base - path),path,suffix) <= 0){
+    free(key);
+    key = strdup(path);
+  }
+  return key;
+}
+
+static bool band_busy(char const *band){
+  for(int i = 0; i < Workers; i++)
+    if(Pool.busy[i] != NULL && strcmp(Pool.busy[i],band) == 0)
+      return true;
+  return false;
+}
+
+static void *spool_worker(void *arg){
+  int const me = (int)(intptr_t)arg;
+  pthread_mutex_lock(&Pool.lock);
+  while(true){
+    // Take the oldest job whose band isn't already being decoded by another worker
+    int i;
+    for(i = 0; i < Pool.count; i++)
+      if(!band_busy(Pool.queue[i].band))
+	break;
+    if(i == Pool.count){
+      pthread_cond_wait(&Pool.changed,&Pool.lock);
+      continue;
+    }
+    struct job const job = Pool.queue[i];
+    Pool.count--;
+    memmove(&Pool.queue[i],&Pool.queue[i+1],(Pool.count - i) * sizeof Pool.queue[0]);
+    Pool.busy[me] = job.band;
+    Pool.busy_path[me] = job.path;
+    pthread_cond_broadcast(&Pool.changed); // There's room in the queue now
+    pthread_mutex_unlock(&Pool.lock);
+
+    process_file(job.path, job.is_ft8, job.base_freq);
+
+    pthread_mutex_lock(&Pool.lock);
+    Pool.busy[me] = NULL;
+    Pool.busy_path[me] = NULL;
+    pthread_cond_broadcast(&Pool.changed); // The band is free again
+    free(job.path);
+    free(job.band);
+  }
+  return NULL;
+}
+
+void start_workers(void){
+  if(Workers <= 0)
+    return;
+  Pool.busy = calloc(Workers,sizeof Pool.busy[0]);
+  Pool.busy_path = calloc(Workers,sizeof Pool.busy_path[0]);
+  for(int i = 0; i < Workers; i++){
+    pthread_t tid;
+    if(pthread_create(&tid,NULL,spool_worker,(void *)(intptr_t)i) != 0){
+      fprintf(stderr,"Can't start decode worker %d: %s\n",i,strerror(errno));
+      abort(); // Queued files would never be decoded
+    }
+    pthread_detach(tid);
+  }
+}
+
+// Hand a file to a worker, or decode it right here when there are no workers
+// Blocks while the queue is full
+void submit_file(char const *path, bool is_ft8, double base_freq){
+  if(Workers <= 0){
+    process_file(path, is_ft8, base_freq);
+    return;
   }
-  if(dirp != NULL){
-    // Probably already closed
-    closedir(dirp); // also closes dir_fd
-    dir_fd = -1;
+  pthread_mutex_lock(&Pool.lock);
+  // inotify and the periodic rescan often report the same file; queue it only once
+  for(int i = 0; i < Pool.count; i++){
+    if(strcmp(Pool.queue[i].path,path) == 0)
+      goto done;
   }
-  if(dir_fd != -1)
-    close(dir_fd); // otherwise close it separately
+  for(int i = 0; i < Workers; i++){
+    if(Pool.busy_path[i] != NULL && strcmp(Pool.busy_path[i],path) == 0)
+      goto done;
+  }
+  while(Pool.count == QUEUE_SIZE)
+    pthread_cond_wait(&Pool.changed,&Pool.lock);
+
+  struct job *jp = &Pool.queue[Pool.count++];
+  jp->path = strdup(path);
+  jp->band = band_key(path);
+  jp->is_ft8 = is_ft8;
+  jp->base_freq = base_freq;
+  pthread_cond_broadcast(&Pool.changed);
+ done:;
+  pthread_mutex_unlock(&Pool.lock);
 }
 
+// Wait until every queued file has been decoded
+void drain_queue(void){
+  if(Workers <= 0)
+    return;
+  pthread_mutex_lock(&Pool.lock);
+  while(true){
+    bool idle = (Pool.count == 0);
+    for(int i = 0; idle && i < Workers; i++)
+      if(Pool.busy[i] != NULL)
+	idle = false;
+    if(idle)
+      break;
+    pthread_cond_wait(&Pool.changed,&Pool.lock);
+  }
+  pthread_mutex_unlock(&Pool.lock);
+}
 
 void usage()
 {
-  fprintf(stderr, "decode_ft8 [-v] [-8|-4] [-d] [-f basefreq] file_or_directory\n");
+  fprintf(stderr, "decode_ft8 [-v] [-8|-4] [-d] [-f basefreq] [-t threads] [-j workers] [-F kiss|fftw] [-S] [-L] [-O depth [-B budget]] [-m passes] [-b low-high] [-D low-high ...] [-H hashfile] [-s [-e seconds]] [-l [-P s16|f32] [-R rate]] file_or_directory_or_source\n");
+}
+// Radio frequency in MHz at zero audio frequency, from extended attribute or file name; 0 if unknown
+double file_base_freq(char const *path){
+  assert(path != NULL);
+  double base_freq = 0;
+  // Look first for extended file attribute "user.frequency" (linux) or "frequency" (macos)
+  char att_buffer[1024] = {0}; // Shouldn't be anywhere near this long
+#ifdef __linux__
+  ssize_t s = getxattr(path,"user.frequency",att_buffer,sizeof(att_buffer) - 1);
+#else
+  ssize_t s = getxattr(path,"frequency",att_buffer,sizeof(att_buffer) - 1,0,0);
+#endif
+  if(s > 0){
+    // Extract from attribute
+    base_freq = strtod(att_buffer,NULL);
+    base_freq /= 1e6; // Hz -> MHz
+    if(Verbose > 1)
+      fprintf(stderr,"Extracted base frequency %lf MHz from attribute\n",base_freq);
+  } else {
+    // Extract from file name; only its last element, since directory names may have _ too
+    char *npath = strdup(path);
+    char const *bn = basename(npath);
+    char const *cp;
+    if((cp = strchr(bn,'_')) != NULL){
+      base_freq = strtod(cp+1,NULL) / 1e6;
+      if(Verbose > 1)
+	fprintf(stderr,"Extracted base frequency %lf MHz from file name\n",base_freq);
+    }
+    free(npath);
+  }
+  return base_freq;
+}
+// UTC of the first sample from extended attribute or file name; false if neither has it
+bool file_start_time(char const *path, struct tm *tmp, double *fsec){
+  bool tmp_set = false;
+  *fsec = 0;
+  {
+    // Look first for extended file attribute "user.unixstarttime" or "unixstarttime"
+    char att_buffer[1024] = {0};
+#ifdef __linux__
+    ssize_t s = getxattr(path,"user.unixstarttime",att_buffer,sizeof(att_buffer) - 1);
+#else
+    ssize_t s = getxattr(path,"unixstarttime",att_buffer,sizeof(att_buffer) - 1,0,0);
+#endif
+    if(s > 0){
+      // Extract from attribute
+      double t = strtod(att_buffer,NULL);
+      time_t tt = t;
+      *fsec = fmod(t,1.0);
+      if(round(t) != floor(t)){
+	// Round up to nearest second, otherwise round down
+	tt++;
+	*fsec -= 1.0;
+      }
+      if(gmtime_r(&tt,tmp) != NULL){
+	tmp_set = true;
+	if(Verbose > 1)
+	  fprintf(stderr,"Time extracted from attribute\n");
+      }
+    }
+  }
+  if(!tmp_set){
+    // that didn't work, try extracting date-time from file name
+      char *npath = strdup(path);
+      char const *bn = basename(npath);
+      int year,mon,day,hr,minute,sec;
+      char junk;
+      int r = sscanf(bn,"%04d%02d%02d%c%02d%02d%02d",&year,&mon,&day,&junk,&hr,&minute,&sec);
+      free(npath);
+      if(r == 7){
+	// Convert to Unix-style struct tm (using its conventions)
+	tmp->tm_year = year - 1900;
+	tmp->tm_mon = mon - 1;
+	tmp->tm_mday = day;
+	tmp->tm_hour = hr;
+	tmp->tm_min = minute;
+	tmp->tm_sec = sec;
+	*fsec = 0; // Not available
+	tmp_set = true;
+	if(Verbose > 1)
+	  fprintf(stderr,"Time extracted from filename\n");
+      }
+  }
+  return tmp_set;
 }
@@ -3,15 +3,22 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include "ft8/text.h"
 #include "ft8/pack.h"
+#include "ft8/unpack.h"
+#include "ft8/hashcall.h"
 #include "ft8/encode.h"
+#include "ft8/ldpc.h"
+#include "ft8/crc.h"
+#include "ft8/decode.h"
 #include "ft8/constants.h"
 
 #include "fft/kiss_fftr.h"
 #include "common/common.h"
 #include "common/debug.h"
+#include "common/mag_db.h"
 
 #define LOG_LEVEL LOG_INFO
 
@@ -150,10 +157,286 @@ void test4()
     printf("F[1] = %.3f dB\n", mag_db[1]);
 }
 
+// Check the selected waterfall magnitude kernel against the log10f() reference
+// Vector kernels may differ by at most one 0.5 dB step
+bool test_mag_db()
+{
+    mag_db_fn fn = mag_db_select();
+    const int n = 4099; // Odd size exercises the scalar tail of the vector kernels
+    kiss_fft_cpx bins[n];
+    uint8_t ref[n], out[n];
+    int mismatches = 0, max_diff = 0;
+
+    for (int pass = 0; pass < 64; ++pass)
+    {
+        // Sweep amplitudes from well below -120 dB to above 0 dB, with a different fine offset each pass
+        for (int i = 0; i < n; ++i)
+        {
+            float db = -140.0f + 160.0f * i / n + pass * (0.5f / 64);
+            float amp = powf(10.0f, db / 20.0f);
+            float phase = 0.1f * i;
+            bins[i].r = amp * cosf(phase);
+            bins[i].i = amp * sinf(phase);
+        }
+        float ref_max = mag_db_scalar(bins, n, ref);
+        float out_max = fn(bins, n, out);
+        if (ref_max != out_max)
+        {
+            printf("mag_db %s: max power %g, expected %g\n", mag_db_name(fn), out_max, ref_max);
+            return false;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            int diff = abs((int)out[i] - (int)ref[i]);
+            if (diff > 0)
+                ++mismatches;
+            if (diff > max_diff)
+                max_diff = diff;
+        }
+    }
+    printf("mag_db %s: %d of %d values off by one step, max difference %d\n", mag_db_name(fn), mismatches, 64 * n, max_diff);
+    return max_diff <= 1;
+}
+
+// bp_decode_batch() must give every codeword exactly what bp_decode() gives it,
+// with lanes finishing at different iterations (clean, noisy, hopeless and all-zero codewords)
+bool test_bp_batch()
+{
+    float llr[64][FTX_LDPC_N];
+    uint8_t plain[FTX_LDPC_N], plain_batch[64][FTX_LDPC_N];
+    int ok, ok_batch[64], iters[64], successes = 0;
+
+    srand(174);
+    for (int i = 0; i < 64; ++i)
+    {
+        // Codeword bits from the data symbols of a random message
+        uint8_t payload[10], tones[FT8_NN], bits[FTX_LDPC_N];
+        for (int j = 0; j < 10; ++j)
+            payload[j] = rand();
+        payload[9] &= 0xF8;
+        ft8_encode(payload, tones);
+        for (int j = 0, k = 0; j < FT8_NN; ++j)
+        {
+            if (j < 7 || (j >= 36 && j < 43) || j >= 72)
+                continue;
+            int b = 0;
+            while (kFT8_Gray_map[b] != tones[j])
+                ++b;
+            bits[k++] = (b >> 2) & 1;
+            bits[k++] = (b >> 1) & 1;
+            bits[k++] = b & 1;
+        }
+        float noise = 0.5f * (i % 5);
+        for (int k = 0; k < FTX_LDPC_N; ++k)
+        {
+            float x = (i % 16 == 15) ? -1.0f : (bits[k] ? 1.0f : -1.0f);
+            llr[i][k] = 2 * (x + noise * ((float)rand() / RAND_MAX - 0.5f) * 3.4f);
+        }
+    }
+    bp_decode_batch(llr, 3, 20, plain_batch, ok_batch, iters); // Fewer codewords than lanes
+    bp_decode_batch(&llr[3], 61, 20, &plain_batch[3], &ok_batch[3], &iters[3]);
+    for (int i = 0; i < 64; ++i)
+    {
+        bp_decode(llr[i], 20, plain, &ok);
+        if (ok != ok_batch[i] || memcmp(plain, plain_batch[i], FTX_LDPC_N) != 0)
+        {
+            printf("bp_decode_batch: codeword %d differs from bp_decode (%d vs %d errors)\n", i, ok_batch[i], ok);
+            return false;
+        }
+        if (ok == 0)
+            ++successes;
+    }
+    printf("bp_decode_batch: 64 codewords identical to bp_decode, %d decoded\n", successes);
+    return true;
+}
+
+// The packed-word parity check and the table-driven CRC-14 must agree with the byte-per-bit parity count
+// and the bitwise CRC on any codeword; a CRC mismatch would reject every decode
+bool test_packed_bits()
+{
+    srand(14);
+    for (int c = 0; c < 1000; ++c)
+    {
+        // Random bits rather than valid codewords, so the parity checks fail in every combination
+        uint8_t plain[FTX_LDPC_N];
+        for (int i = 0; i < FTX_LDPC_N; ++i)
+            plain[i] = (c == 0) ? 0 : (c == 1) ? 1 : rand() & 1;
+
+        int errors = 0;
+        for (int m = 0; m < FTX_LDPC_M; ++m)
+        {
+            uint8_t x = 0;
+            for (int i = 0; i < kFTX_LDPC_Num_rows[m]; ++i)
+                x ^= plain[kFTX_LDPC_Nm[m][i] - 1];
+            errors += (x != 0);
+        }
+        codeword174_t packed;
+        ldpc_pack(plain, &packed);
+        if (ldpc_check_packed(&packed) != errors)
+        {
+            printf("ldpc_check_packed: codeword %d gives %d parity errors, expected %d\n", c, ldpc_check_packed(&packed), errors);
+            return false;
+        }
+
+        uint8_t bytes[FTX_LDPC_K_BYTES] = { 0 };
+        for (int i = 0; i < FTX_LDPC_K; ++i)
+            if (plain[i])
+                bytes[i / 8] |= 0x80 >> (i % 8);
+        for (int num_bits = 1; num_bits <= FTX_LDPC_K; ++num_bits)
+        {
+            uint16_t remainder = 0;
+            for (int i = 0; i < num_bits; ++i)
+            {
+                if (i % 8 == 0)
+                    remainder ^= (bytes[i / 8] << (FT8_CRC_WIDTH - 8));
+                remainder = (remainder & (1u << (FT8_CRC_WIDTH - 1))) ? (remainder << 1) ^ FT8_CRC_POLYNOMIAL : (remainder << 1);
+            }
+            remainder &= (1u << FT8_CRC_WIDTH) - 1u;
+            if (ftx_compute_crc(bytes, num_bits) != remainder)
+            {
+                printf("ftx_compute_crc: codeword %d, %d bits gives %04x, expected %04x\n", c, num_bits, ftx_compute_crc(bytes, num_bits), remainder);
+                return false;
+            }
+        }
+    }
+    printf("packed bits: parity checks and CRC-14 agree with the bitwise versions on 1000 codewords\n");
+    return true;
+}
+
+// The sync search split into parts and merged must give exactly ft8_find_sync()'s candidate list, order and ties
+// included, whether it is split by subdivisions (2 parts) or by frequency ranges (3 and 5 parts)
+bool test_sync_merge()
+{
+    waterfall_t wf = { .max_blocks = 93, .num_blocks = 93, .num_bins = 240, .time_osr = 2, .freq_osr = 2, .protocol = PROTO_FT8 };
+    wf.block_stride = wf.time_osr * wf.freq_osr * wf.num_bins;
+    wf.mag = malloc(wf.max_blocks * wf.block_stride);
+
+    // Coarse noise, so many positions score the same, and a few Costas arrays to be found above it
+    srand(21);
+    for (int i = 0; i < wf.max_blocks * wf.block_stride; ++i)
+        wf.mag[i] = 100 + 4 * (rand() % 4);
+    for (int sig = 0; sig < 12; ++sig)
+    {
+        const int t = 2 + sig % 9, f = 10 + 18 * sig, sub = sig % 4;
+        for (int m = 0; m < FT8_NUM_SYNC; ++m)
+            for (int k = 0; k < FT8_LENGTH_SYNC; ++k)
+                wf.mag[(t + m * FT8_SYNC_OFFSET + k) * wf.block_stride + sub * wf.num_bins + f + kFT8_Costas_pattern[k]] = 140 + 4 * (sig % 3);
+    }
+
+    const int num_candidates = 100;
+    candidate_t ref[100], merged[100];
+    const int num_ref = ft8_find_sync(&wf, num_candidates, ref, 0);
+    const int part_counts[3] = { 2, 3, 5 };
+    bool ok = true;
+    for (int p = 0; p < 3 && ok; ++p)
+    {
+        ft8_sync_part_t parts[5];
+        const int num_parts = ft8_sync_split(&wf, part_counts[p], parts);
+        for (int i = 0; i < num_parts; ++i)
+            ok = ok && ft8_find_sync_part(&wf, num_candidates, 0, &parts[i]);
+        const int num = ft8_find_sync_merge(num_candidates, merged, parts, num_parts);
+        if (!ok || num_parts != part_counts[p] || num != num_ref || memcmp(merged, ref, sizeof(candidate_t) * num) != 0)
+        {
+            printf("sync merge: %d parts give %d candidates, not ft8_find_sync()'s %d in the same order\n", num_parts, num, num_ref);
+            ok = false;
+        }
+    }
+    free(wf.mag);
+    if (ok)
+        printf("sync merge: 2, 3 and 5 parts give ft8_find_sync()'s %d candidates exactly\n", num_ref);
+    return ok;
+}
+
+// Callsign hashes must match WSJT-X's, resolve at every width, survive in a snapshot file,
+// and a full set must give up its least recently used callsign
+bool test_hashcall()
+{
+    // LZ365BM went out as a 22-bit hash in tests/20m_busy/test_29.wav ("<LZ365BM> US5IQI KN87")
+    uint32_t h22, h12, h10;
+    if (!hashcall_compute("LZ365BM", 22, &h22) || h22 != 3144399 || !hashcall_compute("<LZ365BM>", 12, &h12) || h12 != (h22 >> 10)
+        || !hashcall_compute("LZ365BM", 10, &h10) || h10 != (h22 >> 12))
+    {
+        printf("hashcall: wrong hashes for LZ365BM\n");
+        return false;
+    }
+
+    hashcall_clear();
+    char call[12], text[35];
+    uint8_t a77[10];
+    if (hashcall_lookup(h22, 22, call))
+        return false;
+    if (pack77("<PJ4/KA1ABC> K1ABC RR73", a77) != 0 || unpack77(a77, text) != 0 || strcmp(text, "<PJ4/KA1ABC> K1ABC RR73") != 0)
+    {
+        printf("hashcall: pack77/unpack77 of a hashed callsign gave \"%s\"\n", text);
+        return false;
+    }
+    hashcall_save("LZ365BM");
+    const int bits[3] = { 10, 12, 22 };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!hashcall_lookup(h22 >> (22 - bits[i]), bits[i], call) || strcmp(call, "LZ365BM") != 0)
+        {
+            printf("hashcall: %d-bit lookup failed\n", bits[i]);
+            return false;
+        }
+    }
+
+    // More callsigns with the same 10-bit hash, so in the same set
+    char same_set[HASHCALL_WAYS][12];
+    int n = 0;
+    for (uint16_t k = 0; n < HASHCALL_WAYS; ++k)
+    {
+        uint32_t h;
+        snprintf(same_set[n], sizeof(same_set[n]), "T%dX", k);
+        if (hashcall_compute(same_set[n], 10, &h) && h == h10 && strcmp(same_set[n], "LZ365BM") != 0)
+            ++n;
+    }
+    for (int i = 0; i < HASHCALL_WAYS - 1; ++i)
+        hashcall_save(same_set[i]); // The set is full now
+    hashcall_lookup(h22, 22, call); // LZ365BM was saved first but used last
+    hashcall_save(same_set[HASHCALL_WAYS - 1]);
+    hashcall_compute(same_set[0], 22, &h22);
+    if (hashcall_lookup(h22, 22, call) || !hashcall_compute("LZ365BM", 22, &h22) || !hashcall_lookup(h22, 22, call))
+    {
+        printf("hashcall: wrong callsign evicted\n");
+        return false;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_ft8_hashcall.%d", (int)getpid());
+    bool ok = hashcall_open(path);
+    hashcall_save("PJ4/KA1ABC");
+    hashcall_close();
+    hashcall_clear();
+    ok = ok && hashcall_open(path);
+    hashcall_compute("PJ4/KA1ABC", 12, &h12);
+    ok = ok && hashcall_lookup(h12, 12, call) && strcmp(call, "PJ4/KA1ABC") == 0;
+    hashcall_close();
+    unlink(path);
+    if (!ok)
+    {
+        printf("hashcall: snapshot file lost its callsign\n");
+        return false;
+    }
+    printf("hashcall: hashes, lookups, eviction and snapshot file OK\n");
+    return true;
+}
+
 int main()
 {
     //test1();
     test4();
 
+    if (!test_mag_db())
+        return 1;
+    if (!test_bp_batch())
+        return 1;
+    if (!test_packed_bits())
+        return 1;
+    if (!test_sync_merge())
+        return 1;
+    if (!test_hashcall())
+        return 1;
+
     return 0;
 }
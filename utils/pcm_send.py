@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Loopback PCM sender for testing decode_ft8 -l
+# Plays WAV files (mono, 16-bit or float) in real time as raw s16le or f32le, one per slot,
+# starting each at a UTC slot boundary and padding with silence to the end of the slot.
+#
+# pcm_send.py [-4] [--format s16|f32] [--to - | unix:/path | udp:group:port] file.wav ...
+#   decode_ft8 -l -R 12000 unix:/tmp/ft8.sock &
+#   pcm_send.py --to unix:/tmp/ft8.sock tests/20m_busy/*.wav
+
+import sys, time, math, socket, struct, argparse
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-4', dest='ft4', action='store_true', help='FT4 slots (7.5 s) instead of FT8 (15 s)')
+parser.add_argument('--format', default='s16', choices=['s16', 'f32'])
+parser.add_argument('--to', default='-', help='- (stdout), unix:/path or udp:group:port')
+parser.add_argument('--packet', type=float, default=0.02, help='seconds of audio per write')
+parser.add_argument('files', nargs='+')
+args = parser.parse_args()
+
+slot_time = 7.5 if args.ft4 else 15.0
+
+if args.to == '-':
+    out = sys.stdout.buffer
+    send = lambda b: (out.write(b), out.flush())
+elif args.to.startswith('unix:'):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(args.to[5:])
+    send = sock.sendall
+elif args.to.startswith('udp:'):
+    group, port = args.to[4:].rsplit(':', 1)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    send = lambda b: sock.sendto(b, (group, int(port)))
+else:
+    sys.exit('unknown destination ' + args.to)
+
+def read_samples(path):
+    # Minimal RIFF parser; the wave module handles only PCM, not float
+    with open(path, 'rb') as f:
+        data = f.read()
+    pos = 12
+    fmt = bits = rate = None
+    while pos + 8 <= len(data):
+        cid, size = data[pos:pos+4], struct.unpack('<I', data[pos+4:pos+8])[0]
+        if cid == b'fmt ':
+            fmt, channels, rate = struct.unpack('<HHI', data[pos+8:pos+16])
+            bits = struct.unpack('<H', data[pos+22:pos+24])[0]
+        elif cid == b'data':
+            body = data[pos+8:pos+8+size]
+            if fmt == 1 and bits == 16:
+                return rate, [x / 32768.0 for x in struct.unpack('<%dh' % (len(body) // 2), body[:len(body) // 2 * 2])]
+            if fmt == 3 and bits == 32:
+                return rate, list(struct.unpack('<%df' % (len(body) // 4), body[:len(body) // 4 * 4]))
+            sys.exit('%s: unsupported format %s/%s' % (path, fmt, bits))
+        pos += 8 + size + (size & 1)
+    sys.exit(path + ': no data')
+
+def encode(samples):
+    if args.format == 'f32':
+        return struct.pack('<%df' % len(samples), *samples)
+    return struct.pack('<%dh' % len(samples), *[max(-32768, min(32767, int(round(x * 32768)))) for x in samples])
+
+# Start on the next slot boundary
+start = math.ceil(time.time() / slot_time) * slot_time
+for path in args.files:
+    rate, samples = read_samples(path)
+    slot_samples = int(slot_time * rate)
+    samples = (samples + [0.0] * slot_samples)[:slot_samples]
+    chunk = max(1, int(args.packet * rate))
+    sys.stderr.write('%s at %s\n' % (path, time.strftime('%H:%M:%S', time.gmtime(start))))
+    for i in range(0, slot_samples, chunk):
+        # Send each chunk when its last sample would have been captured
+        due = start + (i + chunk) / rate
+        delay = due - time.time()
+        if delay > 0:
+            time.sleep(delay)
+        send(encode(samples[i:i+chunk]))
+    start += slot_time
@@ -3,11 +3,12 @@
 import sys, os, subprocess
 
 def parse(line):
+    # Message follows the '~' in both the reference files and decode_ft8 output
     fields = line.strip().split()
-    freq = fields[3]
-    dest = fields[5] if len(fields) > 5 else ''
-    source = fields[6] if len(fields) > 6 else ''
-    report = fields[7] if len(fields) > 7 else ''
+    fields = fields[fields.index('~') + 1:] if '~' in fields else fields[5:]
+    dest = fields[0] if len(fields) > 0 else ''
+    source = fields[1] if len(fields) > 1 else ''
+    report = fields[2] if len(fields) > 2 else ''
     if dest and dest[0] == '<' and dest[-1] == '>':
         dest = '<...>'
     if source and source[0] == '<' and source[-1] == '>':
@@ -19,9 +20,12 @@ wav_files = [os.path.join(wav_dir, f) for f in os.listdir(wav_dir)]
 wav_files = [f for f in wav_files if os.path.isfile(f) and os.path.splitext(f)[1] == '.wav']
 txt_files = [os.path.splitext(f)[0] + '.txt' for f in wav_files]
 
+# run_tests.py wav_dir [-ft4] [extra decode_ft8 options...]
 is_ft4 = False
-if len(sys.argv) > 2 and sys.argv[2] == '-ft4':
+extra_args = sys.argv[2:]
+if len(extra_args) > 0 and extra_args[0] == '-ft4':
     is_ft4 = True
+    extra_args = extra_args[1:]
 
 n_extra = 0
 n_missed = 0
@@ -29,10 +33,11 @@ n_total = 0
 for wav_file, txt_file in zip(wav_files, txt_files):
     if not os.path.isfile(txt_file): continue
     print(wav_file)
-    cmd_args = ['./decode_ft8', wav_file]
+    cmd_args = ['./decode_ft8', '-n'] # -n: decode_ft8 deletes its input files otherwise
     if is_ft4:
-        cmd_args.append('-ft4')
-    result = subprocess.run(cmd_args, stdout=subprocess.PIPE)
+        cmd_args.append('-4')
+    cmd_args += extra_args + [wav_file]
+    result = subprocess.run(cmd_args, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
     result = result.stdout.decode('utf-8').split('\n')
     result = [parse(x) for x in result if len(x) > 0]
     #print(result[0])